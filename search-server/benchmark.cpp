@@ -0,0 +1,550 @@
+// Benchmarks on generated corpora. Each benchmark prints one JSON object per line with its throughput
+// and latency percentiles, so runs can be compared by a script:
+//
+//  search_server_benchmark --documents=100000 --zipf=1.1 --minus=0.2 > results.jsonl
+//
+// Options: --documents --dictionary --document-words --query-words --queries --zipf --minus --duplicates --repeats --seed
+#include "search_server.h"
+#include "process_queries.h"
+#include "query_cache.h"
+#include "query_stats.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "segmented_search_server.h"
+#include "snapshot.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+struct CorpusOptions {
+    size_t document_count = 10'000;
+    size_t dictionary_size = 10'000;
+    size_t document_word_count = 70;
+    size_t query_word_count = 5;
+    size_t query_count = 1'000;
+    // Word ranks follow P(k) ~ 1 / k^s; 0 is uniform
+    double zipf_exponent = 1.0;
+    double minus_word_probability = 0.1;
+    // Share of documents that copy the words of an earlier one, for RemoveDuplicates
+    double duplicate_share = 0.1;
+    // Runs of the benchmarks whose single operation covers the whole corpus
+    size_t repeat_count = 5;
+    uint32_t seed = 42;
+};
+
+struct Corpus {
+    vector<string> dictionary;
+    vector<string> documents;
+    vector<string> queries;
+};
+
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t size, double exponent) {
+        cumulative_weights_.reserve(size);
+        double total = 0.0;
+        for (size_t rank = 1; rank <= size; ++rank) {
+            total += 1.0 / pow(static_cast<double>(rank), exponent);
+            cumulative_weights_.push_back(total);
+        }
+    }
+
+    // Index into the dictionary, 0 being the most frequent word
+    size_t operator()(mt19937& generator) const {
+        const double point = uniform_real_distribution<>(0.0, cumulative_weights_.back())(generator);
+        const size_t rank = upper_bound(cumulative_weights_.begin(), cumulative_weights_.end(), point) - cumulative_weights_.begin();
+        return min(rank, cumulative_weights_.size() - 1);
+    }
+
+private:
+    vector<double> cumulative_weights_;
+};
+
+vector<string> GenerateDictionary(mt19937& generator, size_t word_count) {
+    set<string> words;
+    uniform_int_distribution<int> length(2, 10);
+    uniform_int_distribution<int> letter('a', 'z');
+    while (words.size() < word_count) {
+        string word(length(generator), ' ');
+        for (char& c : word) {
+            c = static_cast<char>(letter(generator));
+        }
+        words.insert(move(word));
+    }
+    vector<string> dictionary(words.begin(), words.end());
+    shuffle(dictionary.begin(), dictionary.end(), generator);
+    return dictionary;
+}
+
+string GenerateText(mt19937& generator, const vector<string>& dictionary, const ZipfDistribution& ranks,
+    size_t word_count, double minus_word_probability) {
+    string text;
+    for (size_t i = 0; i < word_count; ++i) {
+        if (!text.empty()) {
+            text.push_back(' ');
+        }
+        if (minus_word_probability > 0 && uniform_real_distribution<>(0, 1)(generator) < minus_word_probability) {
+            text.push_back('-');
+        }
+        text += dictionary[ranks(generator)];
+    }
+    return text;
+}
+
+Corpus GenerateCorpus(const CorpusOptions& options) {
+    mt19937 generator(options.seed);
+    Corpus corpus;
+    corpus.dictionary = GenerateDictionary(generator, options.dictionary_size);
+    const ZipfDistribution ranks(options.dictionary_size, options.zipf_exponent);
+    corpus.documents.reserve(options.document_count);
+    for (size_t i = 0; i < options.document_count; ++i) {
+        if (i > 0 && uniform_real_distribution<>(0, 1)(generator) < options.duplicate_share) {
+            corpus.documents.push_back(corpus.documents[uniform_int_distribution<size_t>(0, i - 1)(generator)]);
+        }
+        else {
+            corpus.documents.push_back(GenerateText(generator, corpus.dictionary, ranks, options.document_word_count, 0.0));
+        }
+    }
+    corpus.queries.reserve(options.query_count);
+    for (size_t i = 0; i < options.query_count; ++i) {
+        corpus.queries.push_back(GenerateText(generator, corpus.dictionary, ranks, options.query_word_count, options.minus_word_probability));
+    }
+    return corpus;
+}
+
+// Latencies of single operations, reported as a JSON line
+class LatencyRecorder {
+public:
+    using Clock = chrono::steady_clock;
+
+    LatencyRecorder(string_view name, size_t items_per_operation = 1)
+        : name_(name)
+        , items_per_operation_(items_per_operation) {
+    }
+
+    template <typename Operation>
+    void Measure(Operation operation) {
+        const Clock::time_point start = Clock::now();
+        operation();
+        const Clock::duration duration = Clock::now() - start;
+        total_ += duration;
+        latencies_.push_back(duration);
+    }
+
+    void Report(ostream& output) {
+        sort(latencies_.begin(), latencies_.end());
+        const double seconds = chrono::duration<double>(total_).count();
+        const double operations_per_second = seconds > 0 ? latencies_.size() / seconds : 0.0;
+        output << "{\"benchmark\": \"" << name_ << "\""
+            << ", \"operations\": " << latencies_.size()
+            << ", \"seconds\": " << seconds
+            << ", \"operations_per_second\": " << operations_per_second
+            << ", \"items_per_second\": " << operations_per_second * items_per_operation_
+            << ", \"p50_us\": " << GetPercentile(0.5)
+            << ", \"p99_us\": " << GetPercentile(0.99)
+            << ", \"p999_us\": " << GetPercentile(0.999)
+            << ", \"max_us\": " << GetPercentile(1.0)
+            << "}" << endl;
+    }
+
+private:
+    string name_;
+    size_t items_per_operation_;
+    Clock::duration total_{};
+    vector<Clock::duration> latencies_;
+
+    // Nearest rank on sorted latencies
+    double GetPercentile(double share) const {
+        if (latencies_.empty()) {
+            return 0.0;
+        }
+        const size_t rank = static_cast<size_t>(ceil(share * latencies_.size()));
+        return chrono::duration<double, micro>(latencies_[max<size_t>(rank, 1) - 1]).count();
+    }
+};
+
+SearchServer BuildServer(const Corpus& corpus, LatencyRecorder* recorder = nullptr) {
+    SearchServer search_server(corpus.dictionary.front());
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        auto add = [&] {
+            search_server.AddDocument(static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 10) });
+        };
+        if (recorder) {
+            recorder->Measure(add);
+        }
+        else {
+            add();
+        }
+    }
+    return search_server;
+}
+
+vector<NewDocument> MakeNewDocuments(const Corpus& corpus) {
+    vector<NewDocument> documents;
+    documents.reserve(corpus.documents.size());
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        documents.push_back({ static_cast<int>(i), corpus.documents[i], DocumentStatus::ACTUAL, { static_cast<int>(i % 10) } });
+    }
+    return documents;
+}
+
+// Results are summed into result_count so that the work cannot be optimized away
+template <typename Searcher, typename ExecutionPolicy>
+void BenchmarkQueries(string_view name, const Searcher& searcher, const vector<string>& queries, ExecutionPolicy policy,
+    ostream& output, size_t& result_count) {
+    LatencyRecorder recorder(name);
+    for (const string& query : queries) {
+        recorder.Measure([&] { result_count += searcher.FindTopDocuments(policy, query).size(); });
+    }
+    recorder.Report(output);
+}
+
+// Per-stage timings of the queries run since `before`, one JSON line per stage
+void ReportQueryStages(string_view name, const QueryStats& before, ostream& output) {
+    static const char* const stage_names[QUERY_STAGE_COUNT] = { "parse", "traversal", "predicate", "minus", "top_k" };
+    const QueryStats stats = GetQueryStats() - before;
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+        const LatencyHistogram& latencies = stats.Get(static_cast<QueryStage>(stage));
+        output << "{\"benchmark\": \"" << name << "\", \"stage\": \"" << stage_names[stage] << "\""
+            << ", \"samples\": " << latencies.count
+            << ", \"mean_us\": " << latencies.GetMeanNanoseconds() / 1000.0
+            << ", \"p50_us\": " << latencies.GetQuantile(0.5) / 1000.0
+            << ", \"p99_us\": " << latencies.GetQuantile(0.99) / 1000.0
+            << "}" << endl;
+    }
+    output << "{\"benchmark\": \"" << name << "\", \"postings_scanned\": " << stats.Get(QueryCounter::POSTINGS_SCANNED)
+        << ", \"documents_matched\": " << stats.Get(QueryCounter::DOCUMENTS_MATCHED) << "}" << endl;
+}
+
+// Byte at a time, as SplitIntoValidWords did before its block kernels; the baseline of the tokenize benchmark
+void SplitIntoValidWordsScalar(string_view text, vector<string_view>& words) {
+    size_t word_begin = text.size();
+    for (size_t pos = 0; pos < text.size(); ++pos) {
+        const char c = text[pos];
+        if (c >= 0 && c <= 31) {
+            throw invalid_argument("invalid symbol");
+        }
+        if (c == ' ') {
+            if (word_begin != text.size()) {
+                words.push_back(text.substr(word_begin, pos - word_begin));
+                word_begin = text.size();
+            }
+        }
+        else if (word_begin == text.size()) {
+            word_begin = pos;
+        }
+    }
+    if (word_begin != text.size()) {
+        words.push_back(text.substr(word_begin));
+    }
+}
+
+void BenchmarkIndexing(const CorpusOptions& options, const Corpus& corpus, ostream& output, size_t& result_count) {
+    vector<string_view> words;
+    auto benchmark_tokenizer = [&](string_view name, auto split) {
+        LatencyRecorder recorder(name, corpus.documents.size());
+        for (size_t run = 0; run < options.repeat_count; ++run) {
+            recorder.Measure([&] {
+                for (const string& document : corpus.documents) {
+                    words.clear();
+                    split(document, words);
+                    result_count += words.size();
+                }
+                });
+        }
+        recorder.Report(output);
+    };
+    benchmark_tokenizer("tokenize_scalar", SplitIntoValidWordsScalar);
+    benchmark_tokenizer("tokenize", [](string_view text, vector<string_view>& words) { SplitIntoValidWords(text, words); });
+
+    const vector<NewDocument> new_documents = MakeNewDocuments(corpus);
+    LatencyRecorder batch_recorder("add_documents_par", corpus.documents.size());
+    for (size_t run = 0; run < options.repeat_count; ++run) {
+        SearchServer search_server(corpus.dictionary.front());
+        batch_recorder.Measure([&] { search_server.AddDocuments(execution::par, new_documents); });
+        result_count += search_server.GetDocumentCount();
+    }
+    batch_recorder.Report(output);
+
+    // Merges run in the background, so the time to settle is reported on its own
+    SegmentedSearchServer segmented_server(corpus.dictionary.front());
+    LatencyRecorder segmented_add_recorder("segmented_add_document");
+    for (const NewDocument& document : new_documents) {
+        segmented_add_recorder.Measure([&] {
+            segmented_server.AddDocument(document.id, document.text, document.status, document.ratings);
+            });
+    }
+    segmented_add_recorder.Report(output);
+    LatencyRecorder merge_recorder("segmented_wait_for_merges");
+    merge_recorder.Measure([&] { segmented_server.WaitForMerges(); });
+    merge_recorder.Report(output);
+    BenchmarkQueries("segmented_find_top_documents_seq", segmented_server, corpus.queries, execution::seq, output, result_count);
+    BenchmarkQueries("segmented_find_top_documents_par", segmented_server, corpus.queries, execution::par, output, result_count);
+}
+
+void BenchmarkQueryModes(SearchServer& search_server, const Corpus& corpus, ostream& output, size_t& result_count) {
+    const QueryStats before = GetQueryStats();
+    BenchmarkQueries("find_top_documents_seq", search_server, corpus.queries, execution::seq, output, result_count);
+    ReportQueryStages("find_top_documents_seq", before, output);
+    BenchmarkQueries("find_top_documents_par", search_server, corpus.queries, execution::par, output, result_count);
+
+    search_server.SetQueryMode(QueryMode::PRUNED);
+    BenchmarkQueries("find_top_documents_pruned_seq", search_server, corpus.queries, execution::seq, output, result_count);
+    BenchmarkQueries("find_top_documents_pruned_par", search_server, corpus.queries, execution::par, output, result_count);
+    search_server.SetQueryMode(QueryMode::EXHAUSTIVE);
+
+    search_server.SetMatchMode(MatchMode::ALL);
+    BenchmarkQueries("find_top_documents_all_words_seq", search_server, corpus.queries, execution::seq, output, result_count);
+    search_server.SetMatchMode(MatchMode::ANY);
+
+    search_server.SetRankingFunction(RankingFunction::BM25);
+    BenchmarkQueries("find_top_documents_bm25_seq", search_server, corpus.queries, execution::seq, output, result_count);
+    search_server.SetQueryMode(QueryMode::PRUNED);
+    BenchmarkQueries("find_top_documents_bm25_pruned_seq", search_server, corpus.queries, execution::seq, output, result_count);
+    search_server.SetQueryMode(QueryMode::EXHAUSTIVE);
+    search_server.SetRankingFunction(RankingFunction::TF_IDF);
+}
+
+void BenchmarkQueryApis(const CorpusOptions& options, const SearchServer& search_server, const Corpus& corpus,
+    ostream& output, size_t& result_count) {
+    LatencyRecorder match_recorder("match_document");
+    for (size_t i = 0; i < corpus.queries.size(); ++i) {
+        const int document_id = static_cast<int>(i * 7919 % corpus.documents.size());
+        match_recorder.Measure([&] { result_count += get<0>(search_server.MatchDocument(corpus.queries[i], document_id)).size(); });
+    }
+    match_recorder.Report(output);
+
+    // Highlighting asks for the matched words of every result row
+    LatencyRecorder match_batch_recorder("match_documents");
+    DocumentMatches matches;
+    vector<int> document_ids;
+    for (const string& query : corpus.queries) {
+        document_ids.clear();
+        for (const Document& document : search_server.FindTopDocuments(query)) {
+            document_ids.push_back(document.id);
+        }
+        match_batch_recorder.Measure([&] {
+            search_server.MatchDocuments(query, document_ids, matches);
+            result_count += matches.words.size();
+            });
+    }
+    match_batch_recorder.Report(output);
+
+    LatencyRecorder process_recorder("process_queries", corpus.queries.size());
+    for (size_t run = 0; run < options.repeat_count; ++run) {
+        process_recorder.Measure([&] { result_count += ProcessQueries(search_server, corpus.queries).size(); });
+    }
+    process_recorder.Report(output);
+
+    LatencyRecorder batch_recorder("process_queries_batch", corpus.queries.size());
+    for (size_t run = 0; run < options.repeat_count; ++run) {
+        batch_recorder.Measure([&] { result_count += ProcessQueriesBatch(search_server, corpus.queries).documents.size(); });
+    }
+    batch_recorder.Report(output);
+
+    // Query threads share one queue and its statistics
+    const RequestQueue request_queue(search_server);
+    LatencyRecorder queue_recorder("request_queue_process_queries", corpus.queries.size());
+    for (size_t run = 0; run < options.repeat_count; ++run) {
+        queue_recorder.Measure([&] { result_count += ProcessQueries(request_queue, corpus.queries).size(); });
+    }
+    queue_recorder.Report(output);
+
+    // Head traffic: a few popular queries asked again and again
+    QueryCache cache(1'000);
+    LatencyRecorder cache_recorder("find_top_documents_cached");
+    for (size_t i = 0; i < corpus.queries.size(); ++i) {
+        const string& query = corpus.queries[i % min<size_t>(20, corpus.queries.size())];
+        cache_recorder.Measure([&] { result_count += FindTopDocumentsCached(search_server, cache, query).size(); });
+    }
+    cache_recorder.Report(output);
+
+    // Deep pagination: every page resumes after the last document of the one before
+    LatencyRecorder page_recorder("find_top_documents_page");
+    for (const string& query : corpus.queries) {
+        string cursor;
+        for (int page = 0; page < 10; ++page) {
+            SearchPage result;
+            page_recorder.Measure([&] { result = search_server.FindTopDocumentsPage(query, 20, cursor); });
+            result_count += result.documents.size();
+            if (result.next_cursor.empty()) {
+                break;
+            }
+            cursor = move(result.next_cursor);
+        }
+    }
+    page_recorder.Report(output);
+}
+
+// Warm start: opening the mapped snapshot instead of re-adding every document
+void BenchmarkSnapshot(const SearchServer& search_server, const Corpus& corpus, ostream& output, size_t& result_count) {
+    const string path = (filesystem::temp_directory_path() / "search_server_benchmark.snapshot").string();
+    LatencyRecorder save_recorder("snapshot_save");
+    save_recorder.Measure([&] { search_server.SaveSnapshot(path); });
+    save_recorder.Report(output);
+    {
+        LatencyRecorder open_recorder("snapshot_open");
+        optional<SnapshotSearcher> snapshot;
+        open_recorder.Measure([&] { snapshot.emplace(path); });
+        open_recorder.Report(output);
+        BenchmarkQueries("snapshot_find_top_documents_seq", *snapshot, corpus.queries, execution::seq, output, result_count);
+    }
+    filesystem::remove(path);
+}
+
+// Phrases are cut from the documents, so each matches at least one
+void BenchmarkPhraseQueries(const CorpusOptions& options, const Corpus& corpus, ostream& output, size_t& result_count) {
+    SearchServer search_server(corpus.dictionary.front());
+    search_server.SetPositionIndexing(true);
+    LatencyRecorder add_recorder("add_documents_positions_par", corpus.documents.size());
+    add_recorder.Measure([&] { search_server.AddDocuments(execution::par, MakeNewDocuments(corpus)); });
+    add_recorder.Report(output);
+
+    mt19937 generator(options.seed);
+    vector<string> phrase_queries;
+    vector<string> near_queries;
+    for (size_t i = 0; i < options.query_count; ++i) {
+        const vector<string_view> words = SplitIntoWords(corpus.documents[uniform_int_distribution<size_t>(0, corpus.documents.size() - 1)(generator)]);
+        if (words.size() < 3) {
+            continue;
+        }
+        const size_t first = uniform_int_distribution<size_t>(0, words.size() - 3)(generator);
+        phrase_queries.push_back('"' + string(words[first]) + ' ' + string(words[first + 1]) + ' ' + string(words[first + 2]) + '"');
+        near_queries.push_back(string(words[first]) + " NEAR/5 " + string(words[first + 2]));
+    }
+    BenchmarkQueries("find_top_documents_phrase_seq", search_server, phrase_queries, execution::seq, output, result_count);
+    BenchmarkQueries("find_top_documents_near_seq", search_server, near_queries, execution::seq, output, result_count);
+}
+
+void BenchmarkRemoval(const CorpusOptions& options, const SearchServer& search_server, ostream& output, size_t& result_count) {
+    vector<int> document_ids(search_server.begin(), search_server.end());
+    mt19937 generator(options.seed);
+    shuffle(document_ids.begin(), document_ids.end(), generator);
+    document_ids.resize(min(document_ids.size(), options.query_count));
+    {
+        SearchServer removal_server = search_server;
+        LatencyRecorder remove_recorder("remove_document");
+        for (int document_id : document_ids) {
+            remove_recorder.Measure([&] { removal_server.RemoveDocument(document_id); });
+        }
+        remove_recorder.Report(output);
+    }
+
+    LatencyRecorder batch_recorder("remove_documents_par", document_ids.size());
+    for (size_t run = 0; run < options.repeat_count; ++run) {
+        SearchServer removal_server = search_server;
+        batch_recorder.Measure([&] { removal_server.RemoveDocuments(execution::par, document_ids); });
+    }
+    batch_recorder.Report(output);
+
+    LatencyRecorder duplicates_recorder("remove_duplicates", search_server.GetDocumentCount());
+    for (size_t run = 0; run < options.repeat_count; ++run) {
+        SearchServer duplicates_server = search_server;
+        duplicates_recorder.Measure([&] { result_count += RemoveDuplicates(duplicates_server).size(); });
+    }
+    duplicates_recorder.Report(output);
+
+    LatencyRecorder near_recorder("find_near_duplicates_par", search_server.GetDocumentCount());
+    for (size_t run = 0; run < options.repeat_count; ++run) {
+        near_recorder.Measure([&] { result_count += FindNearDuplicates(execution::par, search_server, 0.8).size(); });
+    }
+    near_recorder.Report(output);
+}
+
+void RunBenchmarks(const CorpusOptions& options, ostream& output) {
+    const Corpus corpus = GenerateCorpus(options);
+    output << "{\"corpus\": {\"documents\": " << options.document_count
+        << ", \"dictionary\": " << options.dictionary_size
+        << ", \"document_words\": " << options.document_word_count
+        << ", \"query_words\": " << options.query_word_count
+        << ", \"queries\": " << options.query_count
+        << ", \"zipf\": " << options.zipf_exponent
+        << ", \"minus\": " << options.minus_word_probability
+        << ", \"duplicates\": " << options.duplicate_share
+        << ", \"seed\": " << options.seed << "}}" << endl;
+
+    LatencyRecorder add_recorder("add_document");
+    SearchServer search_server = BuildServer(corpus, &add_recorder);
+    add_recorder.Report(output);
+
+    size_t result_count = 0;
+    BenchmarkIndexing(options, corpus, output, result_count);
+    BenchmarkQueryModes(search_server, corpus, output, result_count);
+    BenchmarkQueryApis(options, search_server, corpus, output, result_count);
+    BenchmarkSnapshot(search_server, corpus, output, result_count);
+    BenchmarkPhraseQueries(options, corpus, output, result_count);
+    BenchmarkRemoval(options, search_server, output, result_count);
+    cerr << "checksum " << result_count << endl;
+}
+
+CorpusOptions ParseOptions(int argc, char* argv[]) {
+    CorpusOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const string_view argument = argv[i];
+        const size_t equals = argument.find('=');
+        if (argument.substr(0, 2) != "--" || equals == string_view::npos) {
+            throw invalid_argument("expected --name=value, got " + string(argument));
+        }
+        const string_view name = argument.substr(2, equals - 2);
+        const string value(argument.substr(equals + 1));
+        if (name == "documents") {
+            options.document_count = stoul(value);
+        }
+        else if (name == "dictionary") {
+            options.dictionary_size = stoul(value);
+        }
+        else if (name == "document-words") {
+            options.document_word_count = stoul(value);
+        }
+        else if (name == "query-words") {
+            options.query_word_count = stoul(value);
+        }
+        else if (name == "queries") {
+            options.query_count = stoul(value);
+        }
+        else if (name == "zipf") {
+            options.zipf_exponent = stod(value);
+        }
+        else if (name == "minus") {
+            options.minus_word_probability = stod(value);
+        }
+        else if (name == "duplicates") {
+            options.duplicate_share = stod(value);
+        }
+        else if (name == "repeats") {
+            options.repeat_count = stoul(value);
+        }
+        else if (name == "seed") {
+            options.seed = static_cast<uint32_t>(stoul(value));
+        }
+        else {
+            throw invalid_argument("unknown option " + string(name));
+        }
+    }
+    if (options.document_count == 0 || options.dictionary_size < 2) {
+        throw invalid_argument("need at least one document and two dictionary words");
+    }
+    return options;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        RunBenchmarks(ParseOptions(argc, argv), cout);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+}
@@ -0,0 +1,44 @@
+#include "concurrent_search_server.h"
+
+using namespace std;
+
+ConcurrentSearchServer::ConcurrentSearchServer(const SearchServer& search_server)
+    : pending_(search_server)
+    , published_(new SearchServer(search_server)) {
+}
+
+ConcurrentSearchServer::~ConcurrentSearchServer() {
+    delete published_.load();
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    lock_guard guard(writer_mutex_);
+    pending_.AddDocument(document_id, document, status, ratings);
+}
+
+void ConcurrentSearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    lock_guard guard(writer_mutex_);
+    pending_.AddDocuments(execution::par, documents);
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    lock_guard guard(writer_mutex_);
+    pending_.RemoveDocument(document_id);
+}
+
+void ConcurrentSearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    lock_guard guard(writer_mutex_);
+    pending_.RemoveDocuments(execution::par, document_ids);
+}
+
+void ConcurrentSearchServer::Publish() {
+    lock_guard guard(writer_mutex_);
+    const SearchServer* previous = published_.exchange(new SearchServer(pending_));
+    epochs_.Retire(shared_ptr<const SearchServer>(previous));
+}
+
+ConcurrentSearchServer::Reader ConcurrentSearchServer::Pin() const {
+    // The epoch is announced before the pointer is read, so the generation cannot be reclaimed under the reader
+    EpochDomain::Guard guard = epochs_.Pin();
+    return { move(guard), published_.load() };
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+#include "document.h"
+#include "epoch.h"
+#include "search_server.h"
+
+// SearchServer that keeps answering queries while documents are ingested.
+// The writer applies changes to a private copy and publishes it as an immutable generation;
+// readers pin the current generation without locks and never see a half-applied change.
+// A publish copies the whole index, so changes should be published in batches.
+class ConcurrentSearchServer {
+public:
+    // A pinned generation; hold it for one request, the generation stays valid until it is destroyed
+    class Reader {
+    public:
+        const SearchServer& operator*() const {
+            return *search_server_;
+        }
+        const SearchServer* operator->() const {
+            return search_server_;
+        }
+
+    private:
+        friend class ConcurrentSearchServer;
+
+        Reader(EpochDomain::Guard guard, const SearchServer* search_server)
+            : guard_(std::move(guard))
+            , search_server_(search_server) {
+        }
+
+        EpochDomain::Guard guard_;
+        const SearchServer* search_server_;
+    };
+
+    // The initial contents are published right away
+    explicit ConcurrentSearchServer(const SearchServer& search_server);
+    ConcurrentSearchServer(const ConcurrentSearchServer&) = delete;
+    ConcurrentSearchServer& operator=(const ConcurrentSearchServer&) = delete;
+    // No reader may be pinned any more
+    ~ConcurrentSearchServer();
+
+    // Writers are serialised; their changes stay invisible to readers until Publish
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Tokenizes in parallel, see SearchServer::AddDocuments
+    void AddDocuments(const std::vector<NewDocument>& documents);
+    void RemoveDocument(int document_id);
+    void RemoveDocuments(const std::vector<int>& document_ids);
+    void Publish();
+
+    Reader Pin() const;
+
+private:
+    mutable EpochDomain epochs_;
+    std::mutex writer_mutex_;
+    SearchServer pending_;
+    std::atomic<const SearchServer*> published_;
+};
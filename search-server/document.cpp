@@ -1,3 +1,4 @@
+#include <numeric>
 #include "document.h"
 using namespace std;
 
@@ -11,4 +12,12 @@ ostream& operator<<(ostream& os, const Document& doc) {
     auto [document_id, relevance, rating]=doc; 
     os<<"{ document_id = "<<document_id<<", relevance = "<<relevance<<", rating = "<<rating<<" }";    
     return os;
-}
\ No newline at end of file
+}
+
+int ComputeAverageRating(const vector<int>& ratings) {
+    if (ratings.empty()) {
+        return 0;
+    }
+    int rating_sum = accumulate(ratings.begin(), ratings.end(), 0);
+    return rating_sum / static_cast<int>(ratings.size());
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 struct Document {
     Document() = default;
@@ -12,9 +14,22 @@ struct Document {
 
 std::ostream& operator<<(std::ostream& os, const Document& doc);
 
+// Rounded towards zero; 0 for a document without ratings
+int ComputeAverageRating(const std::vector<int>& ratings);
+
 enum class DocumentStatus {
     ACTUAL,
     IRRELEVANT,
     BANNED,
     REMOVED,
 };
+
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
+// One document of a SearchServer::AddDocuments batch; the text must outlive the call
+struct NewDocument {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
@@ -0,0 +1,72 @@
+#include "document_table.h"
+
+using namespace std;
+
+void StatusBitmaps::Set(DocumentOrdinal ordinal, DocumentStatus status) {
+    const size_t word = ordinal / 64;
+    if (word >= words_.front().size()) {
+        for (vector<uint64_t>& words : words_) {
+            words.resize(word + 1, 0);
+        }
+    }
+    if (static_cast<size_t>(status) < DOCUMENT_STATUS_COUNT) {
+        words_[static_cast<size_t>(status)][word] |= uint64_t{ 1 } << (ordinal % 64);
+    }
+}
+
+void StatusBitmaps::Clear(DocumentOrdinal ordinal, DocumentStatus status) {
+    const size_t word = ordinal / 64;
+    if (static_cast<size_t>(status) < DOCUMENT_STATUS_COUNT && word < words_.front().size()) {
+        words_[static_cast<size_t>(status)][word] &= ~(uint64_t{ 1 } << (ordinal % 64));
+    }
+}
+
+optional<OrdinalBitmap> StatusBitmaps::Find(DocumentStatus status) const {
+    if (static_cast<size_t>(status) >= DOCUMENT_STATUS_COUNT) {
+        return nullopt;
+    }
+    return OrdinalBitmap{ words_[static_cast<size_t>(status)].data() };
+}
+
+void StatusBitmaps::ShrinkToFit() {
+    for (vector<uint64_t>& words : words_) {
+        words.shrink_to_fit();
+    }
+}
+
+DocumentOrdinal DocumentTable::Add(int document_id, int rating, DocumentStatus status, uint32_t word_count) {
+    const DocumentOrdinal ordinal = static_cast<DocumentOrdinal>(ids_.size());
+    ids_.push_back(document_id);
+    ratings_.push_back(rating);
+    statuses_.push_back(status);
+    word_counts_.push_back(word_count);
+    status_bitmaps_.Set(ordinal, status);
+    ++live_count_;
+    live_word_count_ += word_count;
+    return ordinal;
+}
+
+void DocumentTable::Remove(DocumentOrdinal ordinal) {
+    status_bitmaps_.Clear(ordinal, statuses_[ordinal]);
+    --live_count_;
+    live_word_count_ -= word_counts_[ordinal];
+}
+
+double DocumentTable::GetAverageWordCount() const {
+    return live_count_ == 0 ? 0.0 : live_word_count_ * 1.0 / live_count_;
+}
+
+void DocumentTable::Reserve(size_t ordinal_count) {
+    ids_.reserve(ordinal_count);
+    ratings_.reserve(ordinal_count);
+    statuses_.reserve(ordinal_count);
+    word_counts_.reserve(ordinal_count);
+}
+
+void DocumentTable::ShrinkToFit() {
+    ids_.shrink_to_fit();
+    ratings_.shrink_to_fit();
+    statuses_.shrink_to_fit();
+    word_counts_.shrink_to_fit();
+    status_bitmaps_.ShrinkToFit();
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "document.h"
+#include "ordinal_set.h"
+
+// What ranking needs to know about a matched document
+struct DocumentInfo {
+    int id;
+    int rating;
+    DocumentStatus status;
+};
+
+// Set of ordinals with one bit each. Passed to the evaluation in place of a predicate,
+// it admits documents without fetching their info; it must cover every ordinal below ordinal_count.
+struct OrdinalBitmap {
+    const uint64_t* words = nullptr;
+
+    bool Contains(DocumentOrdinal ordinal) const {
+        return (words[ordinal / 64] >> (ordinal % 64)) & 1;
+    }
+};
+
+// One bitmap per status, each covering every ordinal seen so far
+class StatusBitmaps {
+public:
+    void Set(DocumentOrdinal ordinal, DocumentStatus status);
+    void Clear(DocumentOrdinal ordinal, DocumentStatus status);
+    // Returns nullopt for values outside DocumentStatus
+    std::optional<OrdinalBitmap> Find(DocumentStatus status) const;
+    void ShrinkToFit();
+
+private:
+    std::array<std::vector<uint64_t>, DOCUMENT_STATUS_COUNT> words_;
+};
+
+// Id, rating, status and length of documents by ordinal, each field in its own dense array,
+// so ranking reads them without a lookup by id and a status filter is a bit test
+class DocumentTable {
+public:
+    // Ordinals are handed out in order; word_count is the number of words indexed for the document
+    DocumentOrdinal Add(int document_id, int rating, DocumentStatus status, uint32_t word_count);
+    // The document leaves its status bitmap; its fields stay readable
+    void Remove(DocumentOrdinal ordinal);
+
+    size_t size() const {
+        return ids_.size();
+    }
+    DocumentInfo Get(DocumentOrdinal ordinal) const {
+        return { ids_[ordinal], ratings_[ordinal], statuses_[ordinal] };
+    }
+    std::optional<OrdinalBitmap> FindStatusBitmap(DocumentStatus status) const {
+        return status_bitmaps_.Find(status);
+    }
+    uint32_t GetWordCount(DocumentOrdinal ordinal) const {
+        return word_counts_[ordinal];
+    }
+    // Indexed by ordinal; invalidated by Add
+    const uint32_t* GetWordCounts() const {
+        return word_counts_.data();
+    }
+    // Over the documents not removed; 0 if there are none
+    double GetAverageWordCount() const;
+
+    void Reserve(size_t ordinal_count);
+    void ShrinkToFit();
+
+private:
+    std::vector<int> ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    std::vector<uint32_t> word_counts_;
+    StatusBitmaps status_bitmaps_;
+    size_t live_count_ = 0;
+    uint64_t live_word_count_ = 0;
+};
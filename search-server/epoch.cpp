@@ -0,0 +1,40 @@
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include "epoch.h"
+
+using namespace std;
+
+EpochDomain::Guard EpochDomain::Pin() {
+    // Threads start probing at different slots, so they rarely compete for the same one
+    const size_t first_slot = hash<thread::id>{}(this_thread::get_id()) % SLOT_COUNT;
+    while (true) {
+        for (size_t i = 0; i < SLOT_COUNT; ++i) {
+            Slot& slot = slots_[(first_slot + i) % SLOT_COUNT];
+            // A stale epoch only delays reclamation, so it is safe to announce
+            uint64_t expected = IDLE;
+            if (slot.epoch.compare_exchange_strong(expected, global_epoch_.load())) {
+                return Guard(&slot.epoch);
+            }
+        }
+        this_thread::yield();
+    }
+}
+
+// A reader that announced an epoch before the object was unlinked announced one below retire_epoch;
+// readers announcing retire_epoch or later read the pointer after the unlink and cannot reach the object.
+void EpochDomain::Retire(shared_ptr<const void> object) {
+    const uint64_t retire_epoch = global_epoch_.fetch_add(1) + 1;
+    retired_.emplace_back(retire_epoch, move(object));
+    Reclaim();
+}
+
+void EpochDomain::Reclaim() {
+    uint64_t oldest_epoch = IDLE;
+    for (const Slot& slot : slots_) {
+        oldest_epoch = min(oldest_epoch, slot.epoch.load());
+    }
+    retired_.erase(remove_if(retired_.begin(), retired_.end(), [oldest_epoch](const auto& retired) {
+        return retired.first <= oldest_epoch;
+        }), retired_.end());
+}
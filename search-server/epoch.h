@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation. Readers announce the epoch they entered in a slot of their own and never block;
+// an object unlinked by a writer is destroyed only after every reader that might still see it has left.
+class EpochDomain {
+public:
+    // Readers that pin at the same moment beyond this count wait for a free slot
+    static constexpr size_t SLOT_COUNT = 128;
+
+    class Guard {
+    public:
+        explicit Guard(std::atomic<uint64_t>* slot)
+            : slot_(slot) {
+        }
+        Guard(Guard&& other) noexcept
+            : slot_(std::exchange(other.slot_, nullptr)) {
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        Guard& operator=(Guard&&) = delete;
+        ~Guard() {
+            if (slot_) {
+                slot_->store(IDLE, std::memory_order_release);
+            }
+        }
+
+    private:
+        std::atomic<uint64_t>* slot_;
+    };
+
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    // Objects loaded after Pin stay alive while the guard exists. Lock free.
+    Guard Pin();
+
+    // Takes an object that has just been unlinked from where readers find it and destroys it
+    // once no reader that pinned earlier remains. Retire and Reclaim must not run concurrently with each other.
+    void Retire(std::shared_ptr<const void> object);
+    void Reclaim();
+
+private:
+    static constexpr uint64_t IDLE = ~uint64_t{ 0 };
+
+    // One cache line per slot, so readers do not invalidate each other's lines
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{ IDLE };
+    };
+
+    std::atomic<uint64_t> global_epoch_{ 0 };
+    std::array<Slot, SLOT_COUNT> slots_;
+    // Objects with the epoch in which they were retired
+    std::vector<std::pair<uint64_t, std::shared_ptr<const void>>> retired_;
+};
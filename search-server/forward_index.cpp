@@ -0,0 +1,121 @@
+#include <algorithm>
+#include "forward_index.h"
+
+using namespace std;
+
+namespace {
+
+// Double hashing: probe i of a term is (high + i * low) modulo the filter size
+pair<uint32_t, uint32_t> HashTerm(TermId term) {
+    const uint64_t hash = (term + 1) * 0x9E3779B97F4A7C15ULL;
+    return { static_cast<uint32_t>(hash >> 32), static_cast<uint32_t>(hash) | 1 };
+}
+
+}  // namespace
+
+size_t GetTermBloomWordCount(size_t entry_count) {
+    return (entry_count * TERM_BLOOM_BITS_PER_TERM + 63) / 64;
+}
+
+bool WordFrequencies::ContainsTerm(TermId term) const {
+    if (term_bloom_) {
+        const size_t bit_count = GetTermBloomWordCount(size()) * 64;
+        const auto [high, low] = HashTerm(term);
+        for (size_t i = 0; i < TERM_BLOOM_PROBE_COUNT; ++i) {
+            const size_t bit = (high + i * low) % bit_count;
+            if (((term_bloom_[bit / 64] >> (bit % 64)) & 1) == 0) {
+                return false;
+            }
+        }
+    }
+    return binary_search(first_, last_, TermFreq{ term, 0.0f },
+        [](const TermFreq& lhs, const TermFreq& rhs) { return lhs.term < rhs.term; });
+}
+
+void ForwardIndex::Add(DocumentOrdinal ordinal, const vector<TermFreq>& entries) {
+    if (ordinal >= extents_.size()) {
+        extents_.resize(ordinal + 1);
+    }
+    extents_[ordinal] = { entries_.size(), term_blooms_.size(), static_cast<uint32_t>(entries.size()) };
+    entries_.insert(entries_.end(), entries.begin(), entries.end());
+    AddTermBloom(entries.data(), entries.data() + entries.size());
+}
+
+void ForwardIndex::Remove(DocumentOrdinal ordinal) {
+    if (ordinal >= extents_.size()) {
+        return;
+    }
+    removed_entry_count_ += extents_[ordinal].length;
+    extents_[ordinal] = {};
+    if (removed_entry_count_ > entries_.size() / 2) {
+        Compact();
+    }
+}
+
+void ForwardIndex::RemapTerms(const vector<TermId>& new_terms) {
+    // Entries of removed documents are dropped first, they may refer to terms that are gone
+    if (removed_entry_count_ > 0) {
+        Compact();
+    }
+    for (TermFreq& entry : entries_) {
+        entry.term = new_terms[entry.term];
+    }
+    // The filters hash TermIds
+    term_blooms_.clear();
+    for (Extent& extent : extents_) {
+        extent.bloom_offset = term_blooms_.size();
+        const TermFreq* first = entries_.data() + extent.offset;
+        AddTermBloom(first, first + extent.length);
+    }
+}
+
+WordFrequencies ForwardIndex::Get(DocumentOrdinal ordinal, const TermDictionary& terms) const {
+    if (ordinal >= extents_.size() || extents_[ordinal].length == 0) {
+        return {};
+    }
+    const Extent& extent = extents_[ordinal];
+    const TermFreq* first = entries_.data() + extent.offset;
+    return { first, first + extent.length, terms.GetTerms().data(), term_blooms_.data() + extent.bloom_offset };
+}
+
+size_t ForwardIndex::GetMemoryUsage() const {
+    return entries_.capacity() * sizeof(TermFreq) + term_blooms_.capacity() * sizeof(uint64_t)
+        + extents_.capacity() * sizeof(Extent);
+}
+
+void ForwardIndex::ShrinkToFit() {
+    entries_.shrink_to_fit();
+    term_blooms_.shrink_to_fit();
+    extents_.shrink_to_fit();
+}
+
+void ForwardIndex::Compact() {
+    vector<TermFreq> entries;
+    vector<uint64_t> term_blooms;
+    entries.reserve(entries_.size() - removed_entry_count_);
+    for (Extent& extent : extents_) {
+        const auto first = entries_.begin() + extent.offset;
+        extent.offset = entries.size();
+        entries.insert(entries.end(), first, first + extent.length);
+        const auto bloom_first = term_blooms_.begin() + extent.bloom_offset;
+        extent.bloom_offset = term_blooms.size();
+        term_blooms.insert(term_blooms.end(), bloom_first, bloom_first + GetTermBloomWordCount(extent.length));
+    }
+    entries_.swap(entries);
+    term_blooms_.swap(term_blooms);
+    removed_entry_count_ = 0;
+}
+
+void ForwardIndex::AddTermBloom(const TermFreq* first, const TermFreq* last) {
+    const size_t word_count = GetTermBloomWordCount(last - first);
+    const size_t bloom_offset = term_blooms_.size();
+    term_blooms_.resize(bloom_offset + word_count, 0);
+    uint64_t* bloom = term_blooms_.data() + bloom_offset;
+    for (; first != last; ++first) {
+        const auto [high, low] = HashTerm(first->term);
+        for (size_t i = 0; i < TERM_BLOOM_PROBE_COUNT; ++i) {
+            const size_t bit = (high + i * low) % (word_count * 64);
+            bloom[bit / 64] |= uint64_t{ 1 } << (bit % 64);
+        }
+    }
+}
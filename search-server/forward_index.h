@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "inverted_index.h"
+#include "term_dictionary.h"
+
+struct TermFreq {
+    TermId term;
+    float freq;
+};
+
+// Bloom filter bits kept per term of a document, probed TERM_BLOOM_PROBE_COUNT times per lookup.
+// About 3% of the terms a document lacks get past the filter and need a search of its entries.
+const size_t TERM_BLOOM_BITS_PER_TERM = 8;
+const size_t TERM_BLOOM_PROBE_COUNT = 3;
+
+// Filter words for a document of entry_count terms
+size_t GetTermBloomWordCount(size_t entry_count);
+
+// Read-only view of one document's words with their frequencies, ordered by TermId.
+// Any change to the index invalidates it.
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const TermFreq* entry, const std::string_view* term_words)
+            : entry_(entry)
+            , term_words_(term_words) {
+        }
+
+        value_type operator*() const {
+            return { term_words_[entry_->term], entry_->freq };
+        }
+        Iterator& operator++() {
+            ++entry_;
+            return *this;
+        }
+        bool operator==(const Iterator& other) const {
+            return entry_ == other.entry_;
+        }
+        bool operator!=(const Iterator& other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        const TermFreq* entry_;
+        const std::string_view* term_words_;
+    };
+
+    WordFrequencies() = default;
+    // term_words maps every TermId of the entries to its word. term_bloom, if given, holds
+    // GetTermBloomWordCount(last - first) words of the entries' bloom filter.
+    WordFrequencies(const TermFreq* first, const TermFreq* last, const std::string_view* term_words,
+        const uint64_t* term_bloom = nullptr)
+        : first_(first)
+        , last_(last)
+        , term_words_(term_words)
+        , term_bloom_(term_bloom) {
+    }
+
+    Iterator begin() const {
+        return { first_, term_words_ };
+    }
+    Iterator end() const {
+        return { last_, term_words_ };
+    }
+    size_t size() const {
+        return last_ - first_;
+    }
+    bool empty() const {
+        return first_ == last_;
+    }
+
+    // Raw entries sorted by term
+    const TermFreq* data() const {
+        return first_;
+    }
+    // Consults the bloom filter, when there is one, before searching the entries
+    bool ContainsTerm(TermId term) const;
+
+private:
+    const TermFreq* first_ = nullptr;
+    const TermFreq* last_ = nullptr;
+    const std::string_view* term_words_ = nullptr;
+    const uint64_t* term_bloom_ = nullptr;
+};
+
+// Term lists of all documents, packed one after another in a single array, each with a small bloom filter
+// of its terms so that lookups of absent terms rarely touch the entries.
+// Removed documents leave holes that are squeezed out once they outweigh the live entries.
+class ForwardIndex {
+public:
+    // Entries must be sorted by term and the ordinal must not be stored yet
+    void Add(DocumentOrdinal ordinal, const std::vector<TermFreq>& entries);
+    void Remove(DocumentOrdinal ordinal);
+
+    // Renumbers the terms of every entry; the mapping must keep the order of the terms it keeps
+    void RemapTerms(const std::vector<TermId>& new_terms);
+
+    // Empty for unknown or removed ordinals
+    WordFrequencies Get(DocumentOrdinal ordinal, const TermDictionary& terms) const;
+
+    size_t GetMemoryUsage() const;
+    // Releases spare capacity once no more documents will be added
+    void ShrinkToFit();
+
+private:
+    struct Extent {
+        uint64_t offset = 0;
+        uint64_t bloom_offset = 0;
+        uint32_t length = 0;
+    };
+
+    std::vector<TermFreq> entries_;
+    std::vector<uint64_t> term_blooms_;
+    std::vector<Extent> extents_;
+    size_t removed_entry_count_ = 0;
+
+    void Compact();
+    // Appends the filter of the entries to term_blooms_
+    void AddTermBloom(const TermFreq* first, const TermFreq* last);
+};
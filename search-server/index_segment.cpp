@@ -0,0 +1,79 @@
+#include <algorithm>
+#include "index_segment.h"
+
+using namespace std;
+
+DocumentOrdinal IndexSegment::AddDocument(int document_id, const vector<string_view>& words, DocumentStatus status, int rating) {
+    const DocumentOrdinal ordinal = static_cast<DocumentOrdinal>(documents_.size());
+    vector<TermFreq> term_freqs;
+    for (const auto& [term, term_freq] : InternDocumentTerms(terms_, words)) {
+        postings_.Add(term, ordinal, term_freq);
+        term_freqs.push_back({ term, static_cast<float>(term_freq) });
+    }
+    forward_index_.Add(ordinal, term_freqs);
+    documents_.Add(document_id, rating, status, static_cast<uint32_t>(words.size()));
+    return ordinal;
+}
+
+void IndexSegment::Seal() {
+    postings_.ShrinkToFit();
+    forward_index_.ShrinkToFit();
+    documents_.ShrinkToFit();
+}
+
+IndexSegment IndexSegment::Merge(const vector<const IndexSegment*>& segments, const vector<vector<bool>>& deleted) {
+    IndexSegment merged;
+    DocumentOrdinal first_ordinal = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const IndexSegment& segment = *segments[i];
+        const vector<bool>& segment_deleted = deleted[i];
+
+        // Live documents keep their order, so every posting list is still appended in ordinal order
+        vector<DocumentOrdinal> new_ordinals(segment.GetOrdinalCount());
+        DocumentOrdinal next_ordinal = first_ordinal;
+        for (DocumentOrdinal ordinal = 0; ordinal < segment.GetOrdinalCount(); ++ordinal) {
+            if (!segment_deleted[ordinal]) {
+                new_ordinals[ordinal] = next_ordinal++;
+            }
+        }
+
+        // Terms left only in deleted documents are not carried over
+        vector<TermId> new_terms(segment.GetTermCount(), NO_TERM);
+        for (TermId term = 0; term < segment.GetTermCount(); ++term) {
+            const PostingList* postings = segment.FindPostings(term);
+            if (!postings) {
+                continue;
+            }
+            for (const Posting posting : *postings) {
+                if (segment_deleted[posting.ordinal]) {
+                    continue;
+                }
+                if (new_terms[term] == NO_TERM) {
+                    new_terms[term] = merged.terms_.Intern(segment.terms_.GetTerm(term));
+                }
+                merged.postings_.Add(new_terms[term], new_ordinals[posting.ordinal], posting.term_freq);
+            }
+        }
+
+        vector<TermFreq> entries;
+        for (DocumentOrdinal ordinal = 0; ordinal < segment.GetOrdinalCount(); ++ordinal) {
+            if (segment_deleted[ordinal]) {
+                continue;
+            }
+            const WordFrequencies word_freqs = segment.GetWordFrequencies(ordinal);
+            entries.assign(word_freqs.data(), word_freqs.data() + word_freqs.size());
+            for (TermFreq& entry : entries) {
+                entry.term = new_terms[entry.term];
+            }
+            sort(entries.begin(), entries.end(), [](const TermFreq& lhs, const TermFreq& rhs) {
+                return lhs.term < rhs.term;
+                });
+            merged.forward_index_.Add(new_ordinals[ordinal], entries);
+            const DocumentInfo info = segment.GetDocumentInfo(ordinal);
+            merged.documents_.Add(info.id, info.rating, info.status, segment.documents_.GetWordCount(ordinal));
+        }
+        first_ordinal = next_ordinal;
+    }
+    merged.Seal();
+    return merged;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "document.h"
+#include "document_table.h"
+#include "forward_index.h"
+#include "inverted_index.h"
+#include "term_dictionary.h"
+
+// Self-contained part of a segmented index with its own dictionary, postings and forward index.
+// Documents get local ordinals in the order they are added. A sealed segment is never changed again;
+// deletions are tracked by the owner and dropped when segments are merged.
+class IndexSegment {
+public:
+    // Words must be valid and free of stop words
+    DocumentOrdinal AddDocument(int document_id, const std::vector<std::string_view>& words, DocumentStatus status, int rating);
+    // Releases spare capacity; no documents may be added afterwards
+    void Seal();
+
+    // One sealed segment with the documents of the given segments that deleted[i] does not mark, in order
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& segments, const std::vector<std::vector<bool>>& deleted);
+
+    size_t GetOrdinalCount() const {
+        return documents_.size();
+    }
+    size_t GetTermCount() const {
+        return terms_.size();
+    }
+
+    // Returns NO_TERM for unknown words
+    TermId FindTerm(std::string_view word) const {
+        return terms_.Find(word);
+    }
+    // Returns nullptr for terms without postings
+    const PostingList* FindPostings(TermId term) const {
+        return postings_.Find(term);
+    }
+    DocumentInfo GetDocumentInfo(DocumentOrdinal ordinal) const {
+        return documents_.Get(ordinal);
+    }
+    WordFrequencies GetWordFrequencies(DocumentOrdinal ordinal) const {
+        return forward_index_.Get(ordinal, terms_);
+    }
+
+private:
+    TermDictionary terms_;
+    InvertedIndex postings_;
+    ForwardIndex forward_index_;
+    DocumentTable documents_;
+};
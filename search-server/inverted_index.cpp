@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <string_view>
+#include "inverted_index.h"
+
+using namespace std;
+
+IdfCache::IdfCache(const IdfCache& other)
+    : key_(other.key_.load(memory_order_acquire))
+    , idf_(other.idf_.load(memory_order_relaxed)) {
+}
+
+IdfCache& IdfCache::operator=(const IdfCache& other) {
+    idf_.store(other.idf_.load(memory_order_relaxed), memory_order_relaxed);
+    key_.store(other.key_.load(memory_order_acquire), memory_order_release);
+    return *this;
+}
+
+double IdfCache::Get(size_t document_count, size_t document_freq) const {
+    const uint64_t key = (static_cast<uint64_t>(document_count) << 32) | static_cast<uint32_t>(document_freq);
+    if (key_.load(memory_order_acquire) == key) {
+        return idf_.load(memory_order_relaxed);
+    }
+    const double idf = log(document_count * 1.0 / document_freq);
+    idf_.store(idf, memory_order_relaxed);
+    key_.store(key, memory_order_release);
+    return idf;
+}
+
+void PostingList::Add(DocumentOrdinal ordinal, double term_freq) {
+    // Ordinals grow with every added document, so appending is the common case
+    if (ordinals_.empty() || ordinals_.back() < ordinal) {
+        ordinals_.push_back(ordinal);
+        freqs_.push_back(term_freq);
+        ordinal_set_.Add(ordinal);
+        max_term_freq_ = max(max_term_freq_, term_freq);
+        return;
+    }
+    auto it = lower_bound(ordinals_.begin(), ordinals_.end(), ordinal);
+    const size_t pos = it - ordinals_.begin();
+    if (it != ordinals_.end() && *it == ordinal) {
+        freqs_[pos] += term_freq;
+        max_term_freq_ = max(max_term_freq_, freqs_[pos]);
+        return;
+    }
+    ordinals_.insert(it, ordinal);
+    freqs_.insert(freqs_.begin() + pos, term_freq);
+    ordinal_set_.Add(ordinal);
+    max_term_freq_ = max(max_term_freq_, term_freq);
+}
+
+bool PostingList::Remove(DocumentOrdinal ordinal) {
+    auto it = lower_bound(ordinals_.begin(), ordinals_.end(), ordinal);
+    if (it == ordinals_.end() || *it != ordinal) {
+        return false;
+    }
+    const size_t pos = it - ordinals_.begin();
+    const double removed_freq = freqs_[pos];
+    ordinals_.erase(it);
+    freqs_.erase(freqs_.begin() + pos);
+    ordinal_set_.Remove(ordinal);
+    if (removed_freq >= max_term_freq_) {
+        max_term_freq_ = freqs_.empty() ? 0.0 : *max_element(freqs_.begin(), freqs_.end());
+    }
+    return true;
+}
+
+void PostingList::Remove(const DocumentOrdinal* first, const DocumentOrdinal* last) {
+    if (first == last) {
+        return;
+    }
+    // Postings before the first removed ordinal stay where they are
+    size_t kept = LowerBound(*first);
+    bool max_removed = false;
+    for (size_t i = kept; i < ordinals_.size(); ++i) {
+        while (first != last && *first < ordinals_[i]) {
+            ++first;
+        }
+        if (first != last && *first == ordinals_[i]) {
+            max_removed = max_removed || freqs_[i] >= max_term_freq_;
+            ordinal_set_.Remove(ordinals_[i]);
+            continue;
+        }
+        ordinals_[kept] = ordinals_[i];
+        freqs_[kept] = freqs_[i];
+        ++kept;
+    }
+    ordinals_.resize(kept);
+    freqs_.resize(kept);
+    if (ordinals_.empty()) {
+        ordinals_ = {};
+        freqs_ = {};
+        ordinal_set_ = {};
+        max_term_freq_ = 0.0;
+    }
+    else if (max_removed) {
+        max_term_freq_ = *max_element(freqs_.begin(), freqs_.end());
+    }
+}
+
+bool PostingList::Contains(DocumentOrdinal ordinal) const {
+    return ordinal_set_.Contains(ordinal);
+}
+
+size_t PostingList::LowerBound(DocumentOrdinal ordinal) const {
+    return lower_bound(ordinals_.begin(), ordinals_.end(), ordinal) - ordinals_.begin();
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    return sizeof(PostingList) + ordinals_.capacity() * sizeof(DocumentOrdinal) + freqs_.capacity() * sizeof(double)
+        + ordinal_set_.GetMemoryUsage() - sizeof(OrdinalSet);
+}
+
+void PostingList::ShrinkToFit() {
+    ordinals_.shrink_to_fit();
+    freqs_.shrink_to_fit();
+    ordinal_set_.ShrinkToFit();
+}
+
+double IndexStats::GetBytesPerPosting() const {
+    return posting_count == 0 ? 0.0 : static_cast<double>(memory_bytes) / posting_count;
+}
+
+double IndexStats::GetNestedMapBytesPerPosting() const {
+    return posting_count == 0 ? 0.0 : static_cast<double>(nested_map_memory_bytes) / posting_count;
+}
+
+void InvertedIndex::Add(TermId term, DocumentOrdinal ordinal, double term_freq) {
+    if (term >= postings_.size()) {
+        empty_term_count_ += term + 1 - postings_.size();
+        postings_.resize(term + 1);
+    }
+    if (postings_[term].empty()) {
+        --empty_term_count_;
+    }
+    postings_[term].Add(ordinal, term_freq);
+}
+
+void InvertedIndex::Remove(TermId term, DocumentOrdinal ordinal) {
+    if (term < postings_.size() && postings_[term].Remove(ordinal) && postings_[term].empty()) {
+        ++empty_term_count_;
+    }
+}
+
+void InvertedIndex::RemapTerms(const vector<TermId>& new_terms) {
+    vector<PostingList> postings;
+    for (TermId term = 0; term < postings_.size(); ++term) {
+        const TermId new_term = new_terms[term];
+        if (new_term == NO_TERM) {
+            continue;
+        }
+        if (new_term >= postings.size()) {
+            postings.resize(new_term + 1);
+        }
+        postings[new_term] = move(postings_[term]);
+    }
+    postings_.swap(postings);
+    empty_term_count_ = count_if(postings_.begin(), postings_.end(), [](const PostingList& list) { return list.empty(); });
+}
+
+const PostingList* InvertedIndex::Find(TermId term) const {
+    return term < postings_.size() && !postings_[term].empty() ? &postings_[term] : nullptr;
+}
+
+PostingList* InvertedIndex::Find(TermId term) {
+    return term < postings_.size() && !postings_[term].empty() ? &postings_[term] : nullptr;
+}
+
+IndexStats InvertedIndex::GetStats() const {
+    // Red-black tree node: colour + three links, followed by the stored value
+    constexpr size_t tree_node_overhead = 4 * sizeof(void*);
+
+    IndexStats stats;
+    stats.memory_bytes = (postings_.capacity() - postings_.size()) * sizeof(PostingList);
+    for (const PostingList& postings : postings_) {
+        if (!postings.empty()) {
+            ++stats.term_count;
+        }
+        stats.posting_count += postings.size();
+        stats.memory_bytes += postings.GetMemoryUsage();
+    }
+    stats.nested_map_memory_bytes =
+        stats.term_count * (tree_node_overhead + sizeof(std::string_view) + sizeof(map<int, double>))
+        + stats.posting_count * (tree_node_overhead + sizeof(pair<const int, double>));
+    return stats;
+}
+
+void InvertedIndex::ShrinkToFit() {
+    for (PostingList& postings : postings_) {
+        postings.ShrinkToFit();
+    }
+    postings_.shrink_to_fit();
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <execution>
+#include <numeric>
+#include <utility>
+#include <vector>
+#include "ordinal_set.h"
+#include "term_dictionary.h"
+
+struct Posting {
+    DocumentOrdinal ordinal;
+    double term_freq;
+};
+
+// Non-owning view of one term's postings. Query evaluation reads only spans,
+// whether they point into a PostingList or into a mapped snapshot.
+struct PostingSpan {
+    const DocumentOrdinal* ordinals = nullptr;
+    const double* term_freqs = nullptr;
+    size_t size = 0;
+    double max_term_freq = 0.0;
+    // Same ordinals as a compressed set, when the owner keeps one; mapped snapshots do not
+    const OrdinalSet* ordinal_set = nullptr;
+
+    // Position of the first posting with an ordinal not less than the given one
+    size_t LowerBound(DocumentOrdinal ordinal) const {
+        return std::lower_bound(ordinals, ordinals + size, ordinal) - ordinals;
+    }
+    bool Contains(DocumentOrdinal ordinal) const {
+        const size_t pos = LowerBound(ordinal);
+        return pos < size && ordinals[pos] == ordinal;
+    }
+    // LowerBound among the postings from pos on. Gallops from pos, so a short hop costs a few comparisons.
+    size_t Advance(size_t pos, DocumentOrdinal ordinal) const {
+        size_t bound = pos;
+        for (size_t step = 1; bound < size && ordinals[bound] < ordinal; step *= 2) {
+            pos = bound + 1;
+            bound += step;
+        }
+        return std::lower_bound(ordinals + pos, ordinals + std::min(bound, size), ordinal) - ordinals;
+    }
+};
+
+// Inverse document frequency memoized for the (document count, document frequency) it was computed for.
+// Concurrent readers may race to fill it, but they always store the same value.
+class IdfCache {
+public:
+    IdfCache() = default;
+    IdfCache(const IdfCache& other);
+    IdfCache& operator=(const IdfCache& other);
+
+    double Get(size_t document_count, size_t document_freq) const;
+
+private:
+    static constexpr uint64_t EMPTY_KEY = ~uint64_t{ 0 };
+
+    mutable std::atomic<uint64_t> key_{ EMPTY_KEY };
+    mutable std::atomic<double> idf_{ 0.0 };
+};
+
+// Postings of a single term, kept as two parallel arrays sorted by document ordinal,
+// together with the term statistics queries need. The ordinals are also kept as an OrdinalSet,
+// so membership tests and set operations on whole lists do not have to walk the postings.
+class PostingList {
+public:
+    class Iterator {
+    public:
+        Iterator(const PostingList* list, size_t pos)
+            : list_(list)
+            , pos_(pos) {
+        }
+
+        Posting operator*() const {
+            return { list_->ordinals_[pos_], list_->freqs_[pos_] };
+        }
+        Iterator& operator++() {
+            ++pos_;
+            return *this;
+        }
+        bool operator==(const Iterator& other) const {
+            return pos_ == other.pos_;
+        }
+        bool operator!=(const Iterator& other) const {
+            return pos_ != other.pos_;
+        }
+
+    private:
+        const PostingList* list_;
+        size_t pos_;
+    };
+
+    // Adds term_freq to the posting of the document, creating it if needed
+    void Add(DocumentOrdinal ordinal, double term_freq);
+    // Returns false if the document had no posting in this list
+    bool Remove(DocumentOrdinal ordinal);
+    // Removes the postings of ascending ordinals in one pass; an emptied list releases its memory
+    void Remove(const DocumentOrdinal* first, const DocumentOrdinal* last);
+    bool Contains(DocumentOrdinal ordinal) const;
+    // Position of the first posting with an ordinal not less than the given one
+    size_t LowerBound(DocumentOrdinal ordinal) const;
+
+    size_t size() const {
+        return ordinals_.size();
+    }
+    bool empty() const {
+        return ordinals_.empty();
+    }
+    Iterator begin() const {
+        return { this, 0 };
+    }
+    Iterator end() const {
+        return { this, ordinals_.size() };
+    }
+
+    const std::vector<DocumentOrdinal>& GetOrdinals() const {
+        return ordinals_;
+    }
+    const std::vector<double>& GetTermFreqs() const {
+        return freqs_;
+    }
+    const OrdinalSet& GetOrdinalSet() const {
+        return ordinal_set_;
+    }
+    size_t GetDocumentFreq() const {
+        return ordinals_.size();
+    }
+    double GetMaxTermFreq() const {
+        return max_term_freq_;
+    }
+    // Invalidated by any change to the list
+    PostingSpan GetSpan() const {
+        return { ordinals_.data(), freqs_.data(), ordinals_.size(), max_term_freq_, &ordinal_set_ };
+    }
+    // Computed on first use after the corpus size or this list changes
+    double GetInverseDocumentFreq(size_t document_count) const {
+        return idf_cache_.Get(document_count, ordinals_.size());
+    }
+
+    size_t GetMemoryUsage() const;
+    void ShrinkToFit();
+
+private:
+    std::vector<DocumentOrdinal> ordinals_;
+    std::vector<double> freqs_;
+    OrdinalSet ordinal_set_;
+    double max_term_freq_ = 0.0;
+    IdfCache idf_cache_;
+};
+
+struct IndexStats {
+    size_t term_count = 0;
+    size_t posting_count = 0;
+    size_t memory_bytes = 0;
+    size_t dictionary_memory_bytes = 0;
+    size_t forward_index_memory_bytes = 0;
+    size_t position_index_memory_bytes = 0;
+    // What the same postings cost as std::map<std::string_view, std::map<int, double>>
+    size_t nested_map_memory_bytes = 0;
+
+    double GetBytesPerPosting() const;
+    double GetNestedMapBytesPerPosting() const;
+};
+
+// Posting lists addressed by TermId; a term without postings is treated as absent
+class InvertedIndex {
+public:
+    void Add(TermId term, DocumentOrdinal ordinal, double term_freq);
+    void Remove(TermId term, DocumentOrdinal ordinal);
+    // Each term is handled by one task, so no two tasks touch the same list
+    template <typename ExecutionPolicy>
+    void RemovePostings(ExecutionPolicy&& policy, std::vector<std::pair<TermId, DocumentOrdinal>> postings);
+
+    // Moves every list to new_terms[term]; terms mapped to NO_TERM must have no postings
+    void RemapTerms(const std::vector<TermId>& new_terms);
+    // Terms whose postings were all removed
+    size_t GetEmptyTermCount() const {
+        return empty_term_count_;
+    }
+
+    // Returns nullptr for terms that have no postings
+    const PostingList* Find(TermId term) const;
+    PostingList* Find(TermId term);
+
+    IndexStats GetStats() const;
+    // Releases spare capacity once no more postings will be added
+    void ShrinkToFit();
+
+private:
+    std::vector<PostingList> postings_;
+    size_t empty_term_count_ = 0;
+};
+
+/*********************************************************************************/
+template <typename ExecutionPolicy>
+void InvertedIndex::RemovePostings(ExecutionPolicy&& policy, std::vector<std::pair<TermId, DocumentOrdinal>> postings) {
+    std::sort(policy, postings.begin(), postings.end());
+    std::vector<DocumentOrdinal> ordinals(postings.size());
+    std::vector<size_t> run_starts;
+    for (size_t i = 0; i < postings.size(); ++i) {
+        if (i == 0 || postings[i].first != postings[i - 1].first) {
+            run_starts.push_back(i);
+        }
+        ordinals[i] = postings[i].second;
+    }
+    run_starts.push_back(postings.size());
+
+    std::vector<size_t> runs(run_starts.size() - 1);
+    std::iota(runs.begin(), runs.end(), size_t{ 0 });
+    std::vector<char> emptied(runs.size(), false);
+    std::for_each(policy, runs.begin(), runs.end(), [&](size_t run) {
+        const TermId term = postings[run_starts[run]].first;
+        if (term < postings_.size() && !postings_[term].empty()) {
+            postings_[term].Remove(ordinals.data() + run_starts[run], ordinals.data() + run_starts[run + 1]);
+            emptied[run] = postings_[term].empty();
+        }
+        });
+    empty_term_count_ += std::count(emptied.begin(), emptied.end(), true);
+}
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+#include <utility>
+#include "ordinal_set.h"
+
+using namespace std;
+
+namespace {
+
+uint16_t HighBits(DocumentOrdinal ordinal) {
+    return static_cast<uint16_t>(ordinal >> 16);
+}
+
+uint16_t LowBits(DocumentOrdinal ordinal) {
+    return static_cast<uint16_t>(ordinal & 0xFFFF);
+}
+
+void SetBit(vector<uint64_t>& bits, uint16_t value) {
+    bits[value / 64] |= uint64_t{ 1 } << (value % 64);
+}
+
+}  // namespace
+
+bool OrdinalSet::Container::Contains(uint16_t value) const {
+    if (IsBitmap()) {
+        return (bits[value / 64] >> (value % 64)) & 1;
+    }
+    return binary_search(values.begin(), values.end(), value);
+}
+
+void OrdinalSet::Container::Normalize() {
+    if (IsBitmap()) {
+        cardinality = 0;
+        for (uint64_t word : bits) {
+            cardinality += static_cast<uint32_t>(bitset<64>(word).count());
+        }
+        if (cardinality > ARRAY_MAX_SIZE) {
+            return;
+        }
+        values.reserve(cardinality);
+        for (size_t word = 0; word < BITMAP_WORD_COUNT; ++word) {
+            for (uint64_t word_bits = bits[word]; word_bits != 0; word_bits &= word_bits - 1) {
+                values.push_back(static_cast<uint16_t>(word * 64 + CountTrailingZeros(word_bits)));
+            }
+        }
+        bits = {};
+        return;
+    }
+    cardinality = static_cast<uint32_t>(values.size());
+    if (cardinality <= ARRAY_MAX_SIZE) {
+        return;
+    }
+    bits.assign(BITMAP_WORD_COUNT, 0);
+    for (uint16_t value : values) {
+        SetBit(bits, value);
+    }
+    values = {};
+}
+
+OrdinalSet OrdinalSet::FromSorted(const DocumentOrdinal* first, const DocumentOrdinal* last) {
+    OrdinalSet set;
+    while (first != last) {
+        Container container;
+        container.key = HighBits(*first);
+        const DocumentOrdinal* group_last = first;
+        while (group_last != last && HighBits(*group_last) == container.key) {
+            ++group_last;
+        }
+        if (static_cast<size_t>(group_last - first) > ARRAY_MAX_SIZE) {
+            container.bits.assign(BITMAP_WORD_COUNT, 0);
+            for (; first != group_last; ++first) {
+                SetBit(container.bits, LowBits(*first));
+            }
+        }
+        else {
+            for (; first != group_last; ++first) {
+                container.values.push_back(LowBits(*first));
+            }
+        }
+        container.Normalize();
+        set.containers_.push_back(move(container));
+    }
+    return set;
+}
+
+void OrdinalSet::Add(DocumentOrdinal ordinal) {
+    const uint16_t key = HighBits(ordinal);
+    const uint16_t value = LowBits(ordinal);
+    // Ordinals mostly arrive ascending, so the last container is checked first
+    auto it = !containers_.empty() && containers_.back().key <= key
+        ? containers_.end() - (containers_.back().key == key ? 1 : 0)
+        : lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+            return container.key < key;
+            });
+    if (it == containers_.end() || it->key != key) {
+        it = containers_.insert(it, Container{});
+        it->key = key;
+    }
+    if (it->IsBitmap()) {
+        if (!it->Contains(value)) {
+            SetBit(it->bits, value);
+            ++it->cardinality;
+        }
+        return;
+    }
+    const auto pos = lower_bound(it->values.begin(), it->values.end(), value);
+    if (pos != it->values.end() && *pos == value) {
+        return;
+    }
+    it->values.insert(pos, value);
+    it->Normalize();
+}
+
+void OrdinalSet::Remove(DocumentOrdinal ordinal) {
+    Container* container = FindContainer(HighBits(ordinal));
+    const uint16_t value = LowBits(ordinal);
+    if (!container || !container->Contains(value)) {
+        return;
+    }
+    if (container->IsBitmap()) {
+        container->bits[value / 64] &= ~(uint64_t{ 1 } << (value % 64));
+        // Recounting a whole bitmap on every removal would be slow; it only turns back into an array when small
+        if (--container->cardinality <= ARRAY_MAX_SIZE / 2) {
+            container->Normalize();
+        }
+    }
+    else {
+        container->values.erase(lower_bound(container->values.begin(), container->values.end(), value));
+        container->Normalize();
+    }
+    if (container->cardinality == 0) {
+        containers_.erase(containers_.begin() + (container - containers_.data()));
+    }
+}
+
+bool OrdinalSet::Contains(DocumentOrdinal ordinal) const {
+    const Container* container = FindContainer(HighBits(ordinal));
+    return container && container->Contains(LowBits(ordinal));
+}
+
+size_t OrdinalSet::size() const {
+    size_t size = 0;
+    for (const Container& container : containers_) {
+        size += container.cardinality;
+    }
+    return size;
+}
+
+OrdinalSet OrdinalSet::And(const OrdinalSet& other) const {
+    OrdinalSet result;
+    auto lhs = containers_.begin();
+    auto rhs = other.containers_.begin();
+    while (lhs != containers_.end() && rhs != other.containers_.end()) {
+        if (lhs->key < rhs->key) {
+            ++lhs;
+        }
+        else if (rhs->key < lhs->key) {
+            ++rhs;
+        }
+        else {
+            Container container = And(*lhs++, *rhs++);
+            if (container.cardinality > 0) {
+                result.containers_.push_back(move(container));
+            }
+        }
+    }
+    return result;
+}
+
+OrdinalSet OrdinalSet::Or(const OrdinalSet& other) const {
+    OrdinalSet result;
+    auto lhs = containers_.begin();
+    auto rhs = other.containers_.begin();
+    while (lhs != containers_.end() || rhs != other.containers_.end()) {
+        if (rhs == other.containers_.end() || (lhs != containers_.end() && lhs->key < rhs->key)) {
+            result.containers_.push_back(*lhs++);
+        }
+        else if (lhs == containers_.end() || rhs->key < lhs->key) {
+            result.containers_.push_back(*rhs++);
+        }
+        else {
+            result.containers_.push_back(Or(*lhs++, *rhs++));
+        }
+    }
+    return result;
+}
+
+OrdinalSet OrdinalSet::AndNot(const OrdinalSet& other) const {
+    OrdinalSet result;
+    auto rhs = other.containers_.begin();
+    for (const Container& lhs : containers_) {
+        while (rhs != other.containers_.end() && rhs->key < lhs.key) {
+            ++rhs;
+        }
+        if (rhs == other.containers_.end() || rhs->key != lhs.key) {
+            result.containers_.push_back(lhs);
+            continue;
+        }
+        Container container = AndNot(lhs, *rhs);
+        if (container.cardinality > 0) {
+            result.containers_.push_back(move(container));
+        }
+    }
+    return result;
+}
+
+size_t OrdinalSet::GetMemoryUsage() const {
+    size_t bytes = sizeof(OrdinalSet) + containers_.capacity() * sizeof(Container);
+    for (const Container& container : containers_) {
+        bytes += container.values.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+void OrdinalSet::ShrinkToFit() {
+    containers_.shrink_to_fit();
+    for (Container& container : containers_) {
+        container.values.shrink_to_fit();
+    }
+}
+
+OrdinalSet::Container* OrdinalSet::FindContainer(uint16_t key) {
+    return const_cast<Container*>(as_const(*this).FindContainer(key));
+}
+
+const OrdinalSet::Container* OrdinalSet::FindContainer(uint16_t key) const {
+    const auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& container, uint16_t key) {
+        return container.key < key;
+        });
+    return it != containers_.end() && it->key == key ? &*it : nullptr;
+}
+
+OrdinalSet::Container OrdinalSet::And(const Container& lhs, const Container& rhs) {
+    Container result;
+    result.key = lhs.key;
+    if (lhs.IsBitmap() && rhs.IsBitmap()) {
+        result.bits.resize(BITMAP_WORD_COUNT);
+        for (size_t word = 0; word < BITMAP_WORD_COUNT; ++word) {
+            result.bits[word] = lhs.bits[word] & rhs.bits[word];
+        }
+    }
+    else if (lhs.IsBitmap() || rhs.IsBitmap()) {
+        const Container& array = lhs.IsBitmap() ? rhs : lhs;
+        const Container& bitmap = lhs.IsBitmap() ? lhs : rhs;
+        copy_if(array.values.begin(), array.values.end(), back_inserter(result.values),
+            [&bitmap](uint16_t value) { return bitmap.Contains(value); });
+    }
+    else {
+        set_intersection(lhs.values.begin(), lhs.values.end(), rhs.values.begin(), rhs.values.end(),
+            back_inserter(result.values));
+    }
+    result.Normalize();
+    return result;
+}
+
+OrdinalSet::Container OrdinalSet::Or(const Container& lhs, const Container& rhs) {
+    Container result;
+    result.key = lhs.key;
+    if (lhs.IsBitmap() && rhs.IsBitmap()) {
+        result.bits.resize(BITMAP_WORD_COUNT);
+        for (size_t word = 0; word < BITMAP_WORD_COUNT; ++word) {
+            result.bits[word] = lhs.bits[word] | rhs.bits[word];
+        }
+    }
+    else if (lhs.IsBitmap() || rhs.IsBitmap()) {
+        const Container& array = lhs.IsBitmap() ? rhs : lhs;
+        result.bits = lhs.IsBitmap() ? lhs.bits : rhs.bits;
+        for (uint16_t value : array.values) {
+            SetBit(result.bits, value);
+        }
+    }
+    else {
+        set_union(lhs.values.begin(), lhs.values.end(), rhs.values.begin(), rhs.values.end(),
+            back_inserter(result.values));
+    }
+    result.Normalize();
+    return result;
+}
+
+OrdinalSet::Container OrdinalSet::AndNot(const Container& lhs, const Container& rhs) {
+    Container result;
+    result.key = lhs.key;
+    if (lhs.IsBitmap() && rhs.IsBitmap()) {
+        result.bits.resize(BITMAP_WORD_COUNT);
+        for (size_t word = 0; word < BITMAP_WORD_COUNT; ++word) {
+            result.bits[word] = lhs.bits[word] & ~rhs.bits[word];
+        }
+    }
+    else if (lhs.IsBitmap()) {
+        result.bits = lhs.bits;
+        for (uint16_t value : rhs.values) {
+            result.bits[value / 64] &= ~(uint64_t{ 1 } << (value % 64));
+        }
+    }
+    else {
+        copy_if(lhs.values.begin(), lhs.values.end(), back_inserter(result.values),
+            [&rhs](uint16_t value) { return !rhs.Contains(value); });
+    }
+    result.Normalize();
+    return result;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bits.h"
+
+// Dense internal number of a document, assigned in insertion order and never reused
+using DocumentOrdinal = uint32_t;
+
+// Compressed set of ordinals in the style of roaring bitmaps. Ordinals are grouped by their upper 16 bits;
+// each group is a sorted array of the lower halves while it is sparse and a 65536-bit bitmap once it is dense.
+// A set never takes much more than 2 bytes per member, and the set algebra on dense groups runs a word at a time.
+class OrdinalSet {
+public:
+    // Ordinals must be ascending
+    static OrdinalSet FromSorted(const DocumentOrdinal* first, const DocumentOrdinal* last);
+
+    void Add(DocumentOrdinal ordinal);
+    void Remove(DocumentOrdinal ordinal);
+    bool Contains(DocumentOrdinal ordinal) const;
+
+    size_t size() const;
+    bool empty() const {
+        return containers_.empty();
+    }
+
+    OrdinalSet And(const OrdinalSet& other) const;
+    OrdinalSet Or(const OrdinalSet& other) const;
+    OrdinalSet AndNot(const OrdinalSet& other) const;
+
+    // Calls function(ordinal) for every member in ascending order
+    template <typename Function>
+    void ForEach(Function function) const;
+
+    size_t GetMemoryUsage() const;
+    void ShrinkToFit();
+
+private:
+    // Past this many values a bitmap is smaller than the array
+    static constexpr size_t ARRAY_MAX_SIZE = 4096;
+    static constexpr size_t BITMAP_WORD_COUNT = 65536 / 64;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        // Sorted lower halves while sparse
+        std::vector<uint16_t> values;
+        // BITMAP_WORD_COUNT words once dense; only one of the two is in use
+        std::vector<uint64_t> bits;
+
+        bool IsBitmap() const {
+            return !bits.empty();
+        }
+        bool Contains(uint16_t value) const;
+        // Recounts a bitmap and switches to whichever form suits the cardinality
+        void Normalize();
+    };
+
+    // Ascending keys, no empty containers
+    std::vector<Container> containers_;
+
+    Container* FindContainer(uint16_t key);
+    const Container* FindContainer(uint16_t key) const;
+
+    static Container And(const Container& lhs, const Container& rhs);
+    static Container Or(const Container& lhs, const Container& rhs);
+    static Container AndNot(const Container& lhs, const Container& rhs);
+};
+
+/*********************************************************************************/
+template <typename Function>
+void OrdinalSet::ForEach(Function function) const {
+    for (const Container& container : containers_) {
+        const DocumentOrdinal high = static_cast<DocumentOrdinal>(container.key) << 16;
+        if (!container.IsBitmap()) {
+            for (uint16_t value : container.values) {
+                function(high | value);
+            }
+            continue;
+        }
+        for (size_t word = 0; word < BITMAP_WORD_COUNT; ++word) {
+            for (uint64_t bits = container.bits[word]; bits != 0; bits &= bits - 1) {
+                function(high | static_cast<DocumentOrdinal>(word * 64 + CountTrailingZeros(bits)));
+            }
+        }
+    }
+}
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include "position_index.h"
+
+using namespace std;
+
+namespace {
+
+// Walks a position list forward, decoding one gap at a time
+class PositionReader {
+public:
+    PositionReader(const uint8_t* first, const uint8_t* last)
+        : next_(first)
+        , last_(last) {
+        Advance();
+    }
+
+    bool AtEnd() const {
+        return at_end_;
+    }
+    uint32_t operator*() const {
+        return position_;
+    }
+
+    void Advance() {
+        if (next_ == last_) {
+            at_end_ = true;
+            return;
+        }
+        uint32_t gap = 0;
+        int shift = 0;
+        while (*next_ & 0x80) {
+            gap |= static_cast<uint32_t>(*next_++ & 0x7F) << shift;
+            shift += 7;
+        }
+        gap |= static_cast<uint32_t>(*next_++) << shift;
+        position_ += gap;
+    }
+    // Moves to the first position not less than the target
+    void SkipTo(uint32_t target) {
+        while (!at_end_ && position_ < target) {
+            Advance();
+        }
+    }
+
+private:
+    const uint8_t* next_;
+    const uint8_t* last_;
+    uint32_t position_ = 0;
+    bool at_end_ = false;
+};
+
+void AppendVarint(vector<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+// Whether some position of the first word has every other word at its offset from it.
+// A misaligned word moves the start past its own position, so every list is read at most once.
+bool MatchesPhrase(vector<PositionReader>& readers, const vector<uint32_t>& offsets) {
+    uint32_t start = 0;
+    while (true) {
+        readers[0].SkipTo(start);
+        if (readers[0].AtEnd()) {
+            return false;
+        }
+        start = *readers[0];
+        bool aligned = true;
+        for (size_t i = 1; i < readers.size() && aligned; ++i) {
+            const uint32_t target = start + offsets[i];
+            readers[i].SkipTo(target);
+            if (readers[i].AtEnd()) {
+                return false;
+            }
+            if (*readers[i] != target) {
+                start = *readers[i] - offsets[i];
+                aligned = false;
+            }
+        }
+        if (aligned) {
+            return true;
+        }
+    }
+}
+
+bool MatchesNear(PositionReader& lhs, PositionReader& rhs, uint32_t max_distance) {
+    while (!lhs.AtEnd() && !rhs.AtEnd()) {
+        if (*lhs <= *rhs) {
+            if (*rhs - *lhs <= max_distance) {
+                return true;
+            }
+            lhs.Advance();
+        }
+        else {
+            if (*lhs - *rhs <= max_distance) {
+                return true;
+            }
+            rhs.Advance();
+        }
+    }
+    return false;
+}
+
+// NEAR of a word with itself needs two of its occurrences close enough
+bool MatchesNearSelf(PositionReader& reader, uint32_t max_distance) {
+    uint32_t previous = *reader;
+    for (reader.Advance(); !reader.AtEnd(); reader.Advance()) {
+        if (*reader - previous <= max_distance) {
+            return true;
+        }
+        previous = *reader;
+    }
+    return false;
+}
+
+}  // namespace
+
+void PositionIndex::Add(DocumentOrdinal ordinal, vector<pair<TermId, uint32_t>> occurrences) {
+    if (ordinal >= extents_.size()) {
+        extents_.resize(ordinal + 1);
+    }
+    sort(occurrences.begin(), occurrences.end());
+    Extent extent;
+    extent.entry_offset = entries_.size();
+    extent.byte_offset = bytes_.size();
+    uint32_t previous = 0;
+    for (size_t i = 0; i < occurrences.size(); ++i) {
+        const auto [term, position] = occurrences[i];
+        if (i == 0 || term != occurrences[i - 1].first) {
+            entries_.push_back({ term, static_cast<uint32_t>(bytes_.size() - extent.byte_offset) });
+            previous = 0;
+        }
+        AppendVarint(bytes_, position - previous);
+        previous = position;
+    }
+    extent.entry_count = static_cast<uint32_t>(entries_.size() - extent.entry_offset);
+    extent.byte_count = static_cast<uint32_t>(bytes_.size() - extent.byte_offset);
+    extents_[ordinal] = extent;
+}
+
+void PositionIndex::Remove(DocumentOrdinal ordinal) {
+    if (ordinal >= extents_.size()) {
+        return;
+    }
+    removed_entry_count_ += extents_[ordinal].entry_count;
+    removed_byte_count_ += extents_[ordinal].byte_count;
+    extents_[ordinal] = {};
+    if (removed_byte_count_ > bytes_.size() / 2) {
+        Compact();
+    }
+}
+
+void PositionIndex::RemapTerms(const vector<TermId>& new_terms) {
+    // Entries of removed documents are dropped first, they may refer to terms that are gone
+    if (removed_entry_count_ > 0) {
+        Compact();
+    }
+    for (Entry& entry : entries_) {
+        entry.term = new_terms[entry.term];
+    }
+}
+
+bool PositionIndex::Matches(DocumentOrdinal ordinal, const vector<PositionClause>& clauses) const {
+    return all_of(clauses.begin(), clauses.end(), [this, ordinal](const PositionClause& clause) {
+        return Matches(ordinal, clause);
+        });
+}
+
+size_t PositionIndex::GetMemoryUsage() const {
+    return entries_.capacity() * sizeof(Entry) + bytes_.capacity() + extents_.capacity() * sizeof(Extent);
+}
+
+void PositionIndex::ShrinkToFit() {
+    entries_.shrink_to_fit();
+    bytes_.shrink_to_fit();
+    extents_.shrink_to_fit();
+}
+
+pair<const uint8_t*, const uint8_t*> PositionIndex::FindPositions(DocumentOrdinal ordinal, TermId term) const {
+    if (ordinal >= extents_.size()) {
+        return { nullptr, nullptr };
+    }
+    const Extent& extent = extents_[ordinal];
+    const Entry* first = entries_.data() + extent.entry_offset;
+    const Entry* last = first + extent.entry_count;
+    const Entry* entry = lower_bound(first, last, term, [](const Entry& lhs, TermId rhs) { return lhs.term < rhs; });
+    if (entry == last || entry->term != term) {
+        return { nullptr, nullptr };
+    }
+    const uint8_t* bytes = bytes_.data() + extent.byte_offset;
+    return { bytes + entry->offset, bytes + (entry + 1 == last ? extent.byte_count : (entry + 1)->offset) };
+}
+
+bool PositionIndex::Matches(DocumentOrdinal ordinal, const PositionClause& clause) const {
+    vector<PositionReader> readers;
+    readers.reserve(clause.terms.size());
+    for (TermId term : clause.terms) {
+        const auto [first, last] = FindPositions(ordinal, term);
+        if (first == last) {
+            return false;
+        }
+        readers.emplace_back(first, last);
+    }
+    if (clause.max_distance == 0) {
+        return MatchesPhrase(readers, clause.offsets);
+    }
+    if (clause.terms[0] == clause.terms[1]) {
+        return MatchesNearSelf(readers[0], clause.max_distance);
+    }
+    return MatchesNear(readers[0], readers[1], clause.max_distance);
+}
+
+void PositionIndex::Compact() {
+    vector<Entry> entries;
+    vector<uint8_t> bytes;
+    entries.reserve(entries_.size() - removed_entry_count_);
+    bytes.reserve(bytes_.size() - removed_byte_count_);
+    for (Extent& extent : extents_) {
+        const auto first = entries_.begin() + extent.entry_offset;
+        extent.entry_offset = entries.size();
+        entries.insert(entries.end(), first, first + extent.entry_count);
+        const auto byte_first = bytes_.begin() + extent.byte_offset;
+        extent.byte_offset = bytes.size();
+        bytes.insert(bytes.end(), byte_first, byte_first + extent.byte_count);
+    }
+    entries_.swap(entries);
+    bytes_.swap(bytes);
+    removed_entry_count_ = 0;
+    removed_byte_count_ = 0;
+}
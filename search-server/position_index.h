@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "ordinal_set.h"
+#include "term_dictionary.h"
+
+// A ProximityClause with its words resolved to terms
+struct PositionClause {
+    std::vector<TermId> terms;
+    std::vector<uint32_t> offsets;
+    uint32_t max_distance = 0;
+};
+
+// Word positions of every document, for phrase and NEAR queries. Each document keeps its terms sorted by TermId,
+// each with its ascending positions stored as LEB128 varints of the gaps between them, packed one document after
+// another in a single byte array. Removed documents leave holes that are squeezed out once they outweigh the live bytes.
+class PositionIndex {
+public:
+    // One (term, position) pair per word of the document, in any order; the ordinal must not be stored yet
+    void Add(DocumentOrdinal ordinal, std::vector<std::pair<TermId, uint32_t>> occurrences);
+    void Remove(DocumentOrdinal ordinal);
+
+    // Renumbers the terms of every document; the mapping must keep the order of the terms it keeps
+    void RemapTerms(const std::vector<TermId>& new_terms);
+
+    // Whether the document satisfies every clause. Only the positions of the clause terms are decoded,
+    // lazily and front to back, so a match found early stops the reading.
+    bool Matches(DocumentOrdinal ordinal, const std::vector<PositionClause>& clauses) const;
+
+    size_t GetMemoryUsage() const;
+    // Releases spare capacity once no more documents will be added
+    void ShrinkToFit();
+
+private:
+    struct Entry {
+        TermId term;
+        // From the start of the document's bytes; the list runs to the next entry's offset
+        uint32_t offset;
+    };
+
+    struct Extent {
+        uint64_t entry_offset = 0;
+        uint64_t byte_offset = 0;
+        uint32_t entry_count = 0;
+        uint32_t byte_count = 0;
+    };
+
+    std::vector<Entry> entries_;
+    std::vector<uint8_t> bytes_;
+    std::vector<Extent> extents_;
+    size_t removed_byte_count_ = 0;
+    size_t removed_entry_count_ = 0;
+
+    // Bytes of the term's positions in the document, an empty range if it has none
+    std::pair<const uint8_t*, const uint8_t*> FindPositions(DocumentOrdinal ordinal, TermId term) const;
+    bool Matches(DocumentOrdinal ordinal, const PositionClause& clause) const;
+    void Compact();
+};
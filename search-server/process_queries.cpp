@@ -13,12 +13,26 @@ vector<vector<Document>> ProcessQueries(
     return results;
 }
 
+vector<vector<Document>> ProcessQueries(
+    const RequestQueue& request_queue,
+    const vector<string>& queries) {
+    vector<std::vector<Document>> results(queries.size());
+
+    transform(execution::par, queries.begin(), queries.end(), results.begin(),
+        [&request_queue](const string& query) { return request_queue.AddFindRequest(query); });
+    return results;
+}
+
 
 vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    vector<Document> linearised;
-    for (auto&& res : ProcessQueries(search_server, queries))
-        linearised.insert(linearised.end(), res.begin(), res.end());
-    return linearised;
+    return ProcessQueriesBatch(search_server, queries).documents;
+}
+
+
+QueryBatchResults ProcessQueriesBatch(
+    const SearchServer& search_server,
+    const vector<string>& queries) {
+    return search_server.FindTopDocumentsBatch(execution::par, queries);
 }
\ No newline at end of file
@@ -1,11 +1,22 @@
 #include <vector>
 #include "document.h"
+#include "request_queue.h"
 #include "search_server.h"
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
+// Same as above, with every query recorded in the queue's statistics
+std::vector<std::vector<Document>> ProcessQueries(
+    const RequestQueue& request_queue,
+    const std::vector<std::string>& queries);
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// Results of all queries in one flat array with per-query offsets, see SearchServer::FindTopDocumentsBatch
+QueryBatchResults ProcessQueriesBatch(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <charconv>
+#include <optional>
+#include <stdexcept>
+#include "query.h"
+#include "string_processing.h"
+
+using namespace std;
+
+namespace {
+
+const string_view NEAR_PREFIX = "NEAR/";
+
+struct QueryWord {
+    string_view data;
+    bool is_minus;
+    bool is_stop;
+};
+
+// Symbols are already checked by the tokenizer
+QueryWord ParseQueryWord(string_view text, const StopWords& stop_words) {
+    CheckMinusWord(text);
+    bool is_minus = false;
+    // Word shouldn't be empty
+    if (text[0] == '-') {
+        is_minus = true;
+        text = text.substr(1);
+    }
+    return { text, is_minus, stop_words.count(text) > 0 };
+}
+
+// Distance of a NEAR/k operator, nothing for other words
+optional<uint32_t> ParseNearDistance(string_view word) {
+    if (word.substr(0, NEAR_PREFIX.size()) != NEAR_PREFIX) {
+        return nullopt;
+    }
+    const string_view digits = word.substr(NEAR_PREFIX.size());
+    uint32_t distance = 0;
+    const auto [end, error] = from_chars(digits.data(), digits.data() + digits.size(), distance);
+    if (digits.empty() || error != errc() || end != digits.data() + digits.size() || distance == 0) {
+        throw invalid_argument("invalid NEAR distance");
+    }
+    return distance;
+}
+
+string ToString(const ProximityClause& clause, const StopWords& stop_words) {
+    string text;
+    if (clause.max_distance > 0) {
+        const auto [first, second] = minmax(clause.words[0], clause.words[1]);
+        text += first;
+        text += ' ';
+        text += NEAR_PREFIX;
+        text += to_string(clause.max_distance);
+        text += ' ';
+        text += second;
+        return text;
+    }
+    // Gaps left by stop words are filled with one, so the text parses back to the same offsets
+    text += '"';
+    for (size_t i = 0; i < clause.words.size(); ++i) {
+        if (i > 0) {
+            for (uint32_t gap = clause.offsets[i - 1] + 1; gap < clause.offsets[i]; ++gap) {
+                text += ' ';
+                text += *stop_words.begin();
+            }
+            text += ' ';
+        }
+        text += clause.words[i];
+    }
+    text += '"';
+    return text;
+}
+
+// Words of text into query, phrases and NEAR/k into its clauses
+void ParseProximityQuery(string_view text, const StopWords& stop_words, Query& query) {
+    // Phrase being read and the position of its next word
+    optional<ProximityClause> phrase;
+    uint32_t phrase_position = 0;
+    // Last plain word outside phrases, the left side of a NEAR/k that follows it
+    bool has_near_left = false;
+    QueryWord near_left{};
+    // Distance of a NEAR/k waiting for its right side, 0 for none
+    uint32_t near_distance = 0;
+
+    for (string_view word : SplitIntoValidWords(text)) {
+        if (!phrase) {
+            if (const optional<uint32_t> distance = ParseNearDistance(word)) {
+                if (!has_near_left || near_distance > 0) {
+                    throw invalid_argument("NEAR needs a word on each side");
+                }
+                near_distance = *distance;
+                continue;
+            }
+            if (word[0] == '"') {
+                phrase.emplace();
+                phrase_position = 0;
+                word.remove_prefix(1);
+            }
+        }
+        if (phrase) {
+            if (near_distance > 0) {
+                throw invalid_argument("NEAR needs a word on each side");
+            }
+            has_near_left = false;
+            const bool closes = !word.empty() && word.back() == '"';
+            if (closes) {
+                word.remove_suffix(1);
+            }
+            if (!word.empty()) {
+                if (word[0] == '-') {
+                    throw invalid_argument("minus word in a phrase");
+                }
+                if (stop_words.count(word) == 0) {
+                    phrase->words.push_back(word);
+                    phrase->offsets.push_back(phrase_position);
+                    query.plus_words.push_back(word);
+                }
+                ++phrase_position;
+            }
+            if (closes) {
+                if (!phrase->words.empty()) {
+                    const uint32_t first_offset = phrase->offsets.front();
+                    for (uint32_t& offset : phrase->offsets) {
+                        offset -= first_offset;
+                    }
+                    query.proximity_clauses.push_back(move(*phrase));
+                }
+                phrase.reset();
+            }
+            continue;
+        }
+
+        const QueryWord query_word = ParseQueryWord(word, stop_words);
+        if (query_word.is_minus) {
+            if (near_distance > 0) {
+                throw invalid_argument("NEAR needs a word on each side");
+            }
+            if (query_word.data[0] == '"') {
+                throw invalid_argument("phrases cannot be excluded");
+            }
+            has_near_left = false;
+            if (!query_word.is_stop) {
+                query.minus_words.push_back(query_word.data);
+            }
+            continue;
+        }
+        if (!query_word.is_stop) {
+            query.plus_words.push_back(query_word.data);
+        }
+        if (near_distance > 0) {
+            if (!near_left.is_stop && !query_word.is_stop) {
+                query.proximity_clauses.push_back({ { near_left.data, query_word.data }, { 0, 0 }, near_distance });
+            }
+            near_distance = 0;
+        }
+        has_near_left = true;
+        near_left = query_word;
+    }
+    if (phrase) {
+        throw invalid_argument("unterminated phrase");
+    }
+    if (near_distance > 0) {
+        throw invalid_argument("NEAR needs a word on each side");
+    }
+}
+
+}  // namespace
+
+Query ParseQuery(string_view text, const StopWords& stop_words, bool deduplicate, QuerySyntax syntax) {
+    Query query;
+    if (syntax == QuerySyntax::PLAIN) {
+        for (string_view word : SplitIntoValidWords(text)) {
+            const QueryWord query_word = ParseQueryWord(word, stop_words);
+            if (query_word.is_stop) {
+                continue;
+            }
+            if (query_word.is_minus) {
+                query.minus_words.push_back(query_word.data);
+            }
+            else {
+                query.plus_words.push_back(query_word.data);
+            }
+        }
+    }
+    else {
+        ParseProximityQuery(text, stop_words, query);
+    }
+    if (deduplicate) {
+        sort(query.plus_words.begin(), query.plus_words.end());
+        query.plus_words.erase(unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
+    }
+    return query;
+}
+
+string NormalizeQuery(string_view text, const StopWords& stop_words, QuerySyntax syntax) {
+    Query query = ParseQuery(text, stop_words, true, syntax);
+    sort(query.minus_words.begin(), query.minus_words.end());
+    query.minus_words.erase(unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
+    vector<string> clauses;
+    for (const ProximityClause& clause : query.proximity_clauses) {
+        clauses.push_back(ToString(clause, stop_words));
+    }
+    sort(clauses.begin(), clauses.end());
+    clauses.erase(unique(clauses.begin(), clauses.end()), clauses.end());
+
+    string normalized;
+    for (string_view word : query.plus_words) {
+        if (!normalized.empty()) {
+            normalized += ' ';
+        }
+        normalized += word;
+    }
+    for (string_view word : query.minus_words) {
+        if (!normalized.empty()) {
+            normalized += ' ';
+        }
+        normalized += '-';
+        normalized += word;
+    }
+    for (const string& clause : clauses) {
+        if (!normalized.empty()) {
+            normalized += ' ';
+        }
+        normalized += clause;
+    }
+    return normalized;
+}
+
+void CheckNoProximityClauses(const Query& query) {
+    if (!query.proximity_clauses.empty()) {
+        throw invalid_argument("phrase and NEAR queries need word positions");
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using StopWords = std::set<std::string, std::less<>>;
+
+// Words that must stand close together in a document: a "quoted phrase", or two words joined by NEAR/k
+struct ProximityClause {
+    std::vector<std::string_view> words;
+    // Phrase: where each word stands relative to the first, stop words counted, so the words must sit exactly there
+    std::vector<uint32_t> offsets;
+    // NEAR/k: the two words at most k positions apart, in either order; 0 for a phrase
+    uint32_t max_distance = 0;
+};
+
+struct Query {
+    // Words of the clauses included
+    std::vector<std::string_view> plus_words;
+    std::vector<std::string_view> minus_words;
+    // Every document must satisfy all of them, whatever the match mode
+    std::vector<ProximityClause> proximity_clauses;
+};
+
+enum class QuerySyntax {
+    // Every word is a plus or minus word; quotes and NEAR/k are parts of words
+    PLAIN,
+    // "Quoted phrases" and NEAR/k make proximity clauses, for searchers that index word positions
+    PROXIMITY,
+};
+
+// Words are views into text. Throws invalid_argument on control characters and malformed minus words;
+// with QuerySyntax::PROXIMITY, on unterminated phrases, minus words inside phrases and NEAR/k without a plain word
+// on each side too. Stop words are dropped but keep their place in phrases; a NEAR/k next to a stop word is dropped
+// with it. With deduplicate set, plus words come out sorted and unique.
+Query ParseQuery(std::string_view text, const StopWords& stop_words, bool deduplicate, QuerySyntax syntax);
+
+// Canonical text of a query: sorted unique plus words, then sorted unique minus words, then sorted unique clauses,
+// stop words dropped. Queries that always give the same results normalize to the same text. Throws like ParseQuery.
+std::string NormalizeQuery(std::string_view text, const StopWords& stop_words, QuerySyntax syntax);
+
+// For searchers that keep no word positions: throws invalid_argument if the query has phrase or NEAR clauses
+void CheckNoProximityClauses(const Query& query);
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <functional>
+#include "query_cache.h"
+
+using namespace std;
+
+double QueryCacheStats::GetHitRate() const {
+    const uint64_t request_count = hit_count + miss_count;
+    return request_count == 0 ? 0.0 : static_cast<double>(hit_count) / request_count;
+}
+
+QueryCache::QueryCache(size_t capacity)
+    : shards_(make_unique<Shard[]>(QUERY_CACHE_SHARD_COUNT))
+    , shard_capacity_(max<size_t>(capacity / QUERY_CACHE_SHARD_COUNT, 1)) {
+}
+
+optional<vector<Document>> QueryCache::Find(const string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        miss_count_.fetch_add(1, memory_order_relaxed);
+        return nullopt;
+    }
+    const auto entry = it->second;
+    if (entry->generation != generation) {
+        shard.index.erase(it);
+        shard.entries.erase(entry);
+        stale_count_.fetch_add(1, memory_order_relaxed);
+        miss_count_.fetch_add(1, memory_order_relaxed);
+        return nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+    hit_count_.fetch_add(1, memory_order_relaxed);
+    return entry->documents;
+}
+
+void QueryCache::Insert(const string& key, uint64_t generation, const vector<Document>& documents) {
+    Shard& shard = GetShard(key);
+    lock_guard guard(shard.mutex);
+    if (const auto it = shard.index.find(key); it != shard.index.end()) {
+        // Another thread computed the same query meanwhile; keep whichever saw the newer index
+        const auto entry = it->second;
+        if (entry->generation < generation) {
+            entry->generation = generation;
+            entry->documents = documents;
+        }
+        shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+        return;
+    }
+    if (shard.entries.size() >= shard_capacity_) {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ key, generation, documents });
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+void QueryCache::Clear() {
+    for (size_t i = 0; i < QUERY_CACHE_SHARD_COUNT; ++i) {
+        lock_guard guard(shards_[i].mutex);
+        shards_[i].index.clear();
+        shards_[i].entries.clear();
+    }
+}
+
+QueryCacheStats QueryCache::GetStats() const {
+    QueryCacheStats stats;
+    stats.hit_count = hit_count_.load(memory_order_relaxed);
+    stats.miss_count = miss_count_.load(memory_order_relaxed);
+    stats.stale_count = stale_count_.load(memory_order_relaxed);
+    for (size_t i = 0; i < QUERY_CACHE_SHARD_COUNT; ++i) {
+        lock_guard guard(shards_[i].mutex);
+        stats.size += shards_[i].entries.size();
+    }
+    return stats;
+}
+
+QueryCache::Shard& QueryCache::GetShard(string_view key) const {
+    return shards_[hash<string_view>{}(key) % QUERY_CACHE_SHARD_COUNT];
+}
+
+vector<Document> FindTopDocumentsCached(const SearchServer& search_server, QueryCache& cache, string_view raw_query, DocumentStatus status) {
+    string key = search_server.NormalizeQuery(raw_query);
+    key += '\0';
+    key += to_string(static_cast<int>(status));
+
+    const uint64_t generation = search_server.GetGeneration();
+    if (optional<vector<Document>> documents = cache.Find(key, generation)) {
+        return move(*documents);
+    }
+    vector<Document> documents = search_server.FindTopDocuments(raw_query, status);
+    cache.Insert(key, generation, documents);
+    return documents;
+}
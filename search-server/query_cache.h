@@ -0,0 +1,72 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "document.h"
+#include "search_server.h"
+
+// Shards of a QueryCache; each has its own lock, so concurrent lookups rarely wait on each other
+const size_t QUERY_CACHE_SHARD_COUNT = 16;
+
+struct QueryCacheStats {
+    uint64_t hit_count = 0;
+    uint64_t miss_count = 0;
+    // Entries dropped because the index changed since they were stored
+    uint64_t stale_count = 0;
+    size_t size = 0;
+
+    double GetHitRate() const;
+};
+
+// Results of FindTopDocuments by key, each shard evicting its least recently used entry when full.
+// Every entry remembers the generation of the index it was computed on and is a miss for any other one,
+// so changing the index invalidates the whole cache without touching it. Safe to share between threads.
+class QueryCache {
+public:
+    explicit QueryCache(size_t capacity);
+
+    // Returns nullopt unless the key was stored for this generation
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+    void Insert(const std::string& key, uint64_t generation, const std::vector<Document>& documents);
+    void Clear();
+
+    QueryCacheStats GetStats() const;
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Document> documents;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        // Most recently used first
+        std::list<Entry> entries;
+        // Views into the keys of the entries
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_capacity_;
+    std::atomic<uint64_t> hit_count_{ 0 };
+    std::atomic<uint64_t> miss_count_{ 0 };
+    std::atomic<uint64_t> stale_count_{ 0 };
+
+    Shard& GetShard(std::string_view key) const;
+};
+
+// FindTopDocuments(raw_query, status) answered from the cache when the index has not changed since.
+// The key is the normalized query and the status, so "b a -c a" and "a b -c" share an entry.
+// Predicates have no identity to key on, so calls with a predicate go to the server directly.
+// One cache serves one server.
+std::vector<Document> FindTopDocumentsCached(const SearchServer& search_server, QueryCache& cache,
+    std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
@@ -0,0 +1,846 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "bits.h"
+#include "document.h"
+#include "document_table.h"
+#include "inverted_index.h"
+#include "paginator.h"
+#include "query.h"
+#include "query_stats.h"
+#include "scorer.h"
+#include "score_accumulator.h"
+#include "top_documents.h"
+
+// Smallest ordinal range worth a separate task when a query runs with a parallel policy
+const size_t PARALLEL_QUERY_CHUNK_SIZE = 4096;
+const size_t MAX_PARALLEL_QUERY_CHUNKS = 64;
+// Ordinals a query batch scores at a time; the accumulator of a block (about 200 KB) stays in L2
+const size_t QUERY_BATCH_BLOCK_SIZE = 16 * 1024;
+// Queries of a batch that one task evaluates together, sharing the posting ranges of each block
+const size_t QUERY_BATCH_GROUP_SIZE = 64;
+// Ordinals a pruned query sums at a time; the scores of a window (16 KB) stay in L1
+const size_t PRUNED_WINDOW_SIZE = 2048;
+
+enum class QueryMode {
+    // Scores every posting of every plus word
+    EXHAUSTIVE,
+    // MaxScore: skips documents whose best possible relevance cannot reach the current top, window by window
+    PRUNED,
+};
+
+// How the plus words of a query combine; minus words always exclude (NOT)
+enum class MatchMode {
+    // OR: a document needs at least one plus word
+    ANY,
+    // AND: a document needs every plus word
+    ALL,
+};
+
+struct ScoredPostings {
+    PostingSpan postings;
+    double inverse_document_freq;
+};
+
+// Postings of the words of one query; words missing from the index are left out
+struct QueryPostings {
+    std::vector<ScoredPostings> plus;
+    std::vector<PostingSpan> minus;
+    // Some plus word was left out, so under MatchMode::ALL nothing matches
+    bool has_missing_plus_word = false;
+    // Words of the phrase and NEAR clauses, which every document must contain whatever the match mode
+    std::vector<PostingSpan> required;
+    // Some clause word is missing from the index, so nothing matches
+    bool has_missing_required_word = false;
+};
+
+// Parsed queries of a batch. Every distinct word is resolved once and stored in terms;
+// the plus terms of query i are plus_terms[plus_offsets[i], plus_offsets[i + 1]), the minus terms likewise.
+struct QueryBatch {
+    std::vector<ScoredPostings> terms;
+    std::vector<uint32_t> plus_terms;
+    std::vector<size_t> plus_offsets;
+    std::vector<uint32_t> minus_terms;
+    std::vector<size_t> minus_offsets;
+    // Some query has phrase or NEAR clauses, which the batch evaluation leaves out
+    bool has_proximity_clauses = false;
+
+    size_t size() const {
+        return plus_offsets.size() - 1;
+    }
+};
+
+// Top documents of a batch laid out back to back: those of query i are documents[offsets[i], offsets[i + 1])
+struct QueryBatchResults {
+    std::vector<Document> documents;
+    std::vector<size_t> offsets{ 0 };
+
+    size_t size() const {
+        return offsets.size() - 1;
+    }
+    Range<std::vector<Document>::const_iterator> operator[](size_t query) const {
+        return { documents.begin() + offsets[query], documents.begin() + offsets[query + 1] };
+    }
+};
+
+// Matched words of a MatchDocuments batch laid out back to back: those of document i are words[offsets[i], offsets[i + 1])
+struct DocumentMatches {
+    std::vector<std::string_view> words;
+    std::vector<size_t> offsets{ 0 };
+    std::vector<DocumentStatus> statuses;
+
+    size_t size() const {
+        return statuses.size();
+    }
+    Range<std::vector<std::string_view>::const_iterator> operator[](size_t document) const {
+        return { words.begin() + offsets[document], words.begin() + offsets[document + 1] };
+    }
+    // Keeps the capacity, so a reused batch stops allocating
+    void Clear() {
+        words.clear();
+        offsets.resize(1);
+        statuses.clear();
+    }
+};
+
+// Query evaluation over document ordinals [0, ordinal_count), shared by SearchServer and SnapshotSearcher.
+// Relevance comes from the scorer (see scorer.h), which is a template parameter so that it is inlined.
+// get_document_info(ordinal) must return the DocumentInfo of any ordinal found in the postings.
+// document_predicate is either a callable taking (id, status, rating) or an OrdinalBitmap.
+// Where `after` is taken and set, only documents ranked after it (see IsMoreRelevant) are returned.
+
+// Returns the best `count` documents in ranking order
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> EvaluateQuery(ExecutionPolicy policy, QueryMode mode, MatchMode match_mode, const Scorer& scorer, QueryPostings query_postings,
+    size_t ordinal_count, size_t count, ScoreAccumulatorPool& accumulators,
+    DocumentInfoGetter get_document_info, DocumentPredicate document_predicate);
+
+// The first `count` documents ranked after `after`, or the best ones without it: one page of a search cursor.
+// Either way a deep page only selects `count` documents rather than sorting every match.
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> EvaluateQueryPage(ExecutionPolicy policy, QueryMode mode, MatchMode match_mode, const Scorer& scorer, QueryPostings query_postings,
+    size_t ordinal_count, size_t count, const std::optional<Document>& after, ScoreAccumulatorPool& accumulators,
+    DocumentInfoGetter get_document_info, DocumentPredicate document_predicate);
+
+// Queries with phrase or NEAR clauses, in any query mode: candidates must hold every clause word, and under
+// MatchMode::ALL every plus word, and only they have their positions checked by matches_clauses(ordinal).
+// Where `after` is set, returns the page after it like EvaluateQueryPage.
+template <typename Scorer, typename ClauseMatcher, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsWithClauses(MatchMode match_mode, const Scorer& scorer, const QueryPostings& query_postings,
+    size_t count, const std::optional<Document>& after, ClauseMatcher matches_clauses,
+    DocumentInfoGetter get_document_info, DocumentPredicate document_predicate);
+
+template <typename ExecutionPolicy>
+size_t GetQueryChunkCount(size_t ordinal_count);
+
+// Whether any of the sets holds the ordinal
+inline bool ContainsInAny(const std::vector<const OrdinalSet*>& sets, DocumentOrdinal ordinal) {
+    return std::any_of(sets.begin(), sets.end(), [ordinal](const OrdinalSet* set) { return set->Contains(ordinal); });
+}
+
+template <typename DocumentInfoGetter, typename DocumentPredicate>
+bool IsDocumentAdmitted(DocumentOrdinal ordinal, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate);
+
+// Every document that matches the query, unordered
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindAllDocuments(ExecutionPolicy policy, const Scorer& scorer, const QueryPostings& query_postings,
+    size_t ordinal_count, ScoreAccumulatorPool& accumulators,
+    DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate);
+
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsPruned(ExecutionPolicy policy, const Scorer& scorer, QueryPostings query_postings,
+    size_t ordinal_count, size_t count, const std::optional<Document>& after,
+    DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate);
+
+// MatchMode::ALL: FindTopDocumentsIntersecting over the plus words
+template <typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsMatchingAll(const Scorer& scorer, const QueryPostings& query_postings, size_t count,
+    const std::optional<Document>& after, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate);
+
+// Candidates are the intersection of the ordinal sets of the required postings, smallest first, less the sets
+// of the minus words, so frequent words cost word-wide bitmap operations rather than posting walks.
+// Admitted candidates must pass is_candidate(ordinal) too; the survivors are scored over the plus words they hold,
+// summed in the same order as FindAllDocuments. Runs sequentially: intersections leave few candidates.
+template <typename Scorer, typename CandidateFilter, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsIntersecting(const Scorer& scorer, const QueryPostings& query_postings,
+    const std::vector<PostingSpan>& required, size_t count, const std::optional<Document>& after,
+    CandidateFilter is_candidate, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate);
+
+// Plus terms must be sorted by ascending upper_bounds. Sums the essential terms over windows of PRUNED_WINDOW_SIZE
+// ordinals, then probes the rest only for the documents a window hit.
+template <typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsInRange(const Scorer& scorer, const std::vector<ScoredPostings>& terms, const std::vector<double>& upper_bounds,
+    const std::vector<PostingSpan>& minus_postings, DocumentOrdinal first, DocumentOrdinal last, size_t count,
+    const std::optional<Document>& after, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate);
+
+// Parses all queries up front. find_postings(word) returns std::optional<ScoredPostings> and is called once per distinct word.
+// Throws invalid_argument on the first malformed query.
+template <typename PostingsLookup>
+QueryBatch ParseQueryBatch(const std::vector<std::string>& raw_queries, const StopWords& stop_words, QuerySyntax syntax,
+    PostingsLookup find_postings);
+
+// Same documents as EvaluateQuery in EXHAUSTIVE mode for every query of the batch.
+// Groups of queries walk the ordinals block by block, so the postings of a block are read once per group
+// and stay cached while each query of the group scores them. The output holds `count` slots per query up front.
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+QueryBatchResults EvaluateQueryBatch(ExecutionPolicy policy, const Scorer& scorer, const QueryBatch& batch, size_t ordinal_count, size_t count,
+    ScoreAccumulatorPool& accumulators, DocumentInfoGetter get_document_info, DocumentPredicate document_predicate);
+
+// Answers the queries one by one with searcher.FindTopDocuments(policy, query), for MatchMode::ALL and phrase or NEAR
+// clauses that the batch evaluation lacks
+template <typename ExecutionPolicy, typename Searcher>
+QueryBatchResults FindTopDocumentsEach(ExecutionPolicy policy, const std::vector<std::string>& raw_queries, const Searcher& searcher);
+
+/*********************************************************************************/
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> EvaluateQuery(ExecutionPolicy policy, QueryMode mode, MatchMode match_mode, const Scorer& scorer, QueryPostings query_postings,
+    size_t ordinal_count, size_t count, ScoreAccumulatorPool& accumulators,
+    DocumentInfoGetter get_document_info, DocumentPredicate document_predicate) {
+    if (match_mode == MatchMode::ALL) {
+        return FindTopDocumentsMatchingAll(scorer, query_postings, count, std::nullopt, get_document_info, document_predicate);
+    }
+    if (mode == QueryMode::PRUNED) {
+        return FindTopDocumentsPruned(policy, scorer, std::move(query_postings), ordinal_count, count, std::nullopt,
+            get_document_info, document_predicate);
+    }
+    auto matched_documents = FindAllDocuments(policy, scorer, query_postings, ordinal_count, accumulators, get_document_info, document_predicate);
+    QueryStageTimer top_k_timer(QueryStage::TOP_K);
+    SelectTopDocuments(policy, matched_documents, count);
+    return matched_documents;
+}
+
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> EvaluateQueryPage(ExecutionPolicy policy, QueryMode mode, MatchMode match_mode, const Scorer& scorer, QueryPostings query_postings,
+    size_t ordinal_count, size_t count, const std::optional<Document>& after, ScoreAccumulatorPool& accumulators,
+    DocumentInfoGetter get_document_info, DocumentPredicate document_predicate) {
+    if (match_mode == MatchMode::ALL) {
+        return FindTopDocumentsMatchingAll(scorer, query_postings, count, after, get_document_info, document_predicate);
+    }
+    if (mode == QueryMode::PRUNED) {
+        return FindTopDocumentsPruned(policy, scorer, std::move(query_postings), ordinal_count, count, after,
+            get_document_info, document_predicate);
+    }
+    auto matched_documents = FindAllDocuments(policy, scorer, query_postings, ordinal_count, accumulators, get_document_info, document_predicate);
+    QueryStageTimer top_k_timer(QueryStage::TOP_K);
+    if (after) {
+        matched_documents.erase(std::remove_if(matched_documents.begin(), matched_documents.end(),
+            [&after](const Document& document) { return !IsMoreRelevant(*after, document); }), matched_documents.end());
+    }
+    SelectTopDocuments(policy, matched_documents, count);
+    return matched_documents;
+}
+
+template <typename DocumentInfoGetter, typename DocumentPredicate>
+bool IsDocumentAdmitted(DocumentOrdinal ordinal, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate) {
+    if constexpr (std::is_same_v<std::remove_cv_t<DocumentPredicate>, OrdinalBitmap>) {
+        return document_predicate.Contains(ordinal);
+    }
+    else {
+        const DocumentInfo info = get_document_info(ordinal);
+        return document_predicate(info.id, info.status, info.rating);
+    }
+}
+
+template <typename ExecutionPolicy>
+size_t GetQueryChunkCount(size_t ordinal_count) {
+    if (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        return 1;
+    }
+    return std::clamp<size_t>(ordinal_count / PARALLEL_QUERY_CHUNK_SIZE, 1, MAX_PARALLEL_QUERY_CHUNKS);
+}
+
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindAllDocuments(ExecutionPolicy policy, const Scorer& scorer, const QueryPostings& query_postings,
+    size_t ordinal_count, ScoreAccumulatorPool& accumulators,
+    DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate) {
+    // Parallel tasks own disjoint ordinal ranges of the accumulator, so they never contend
+    const size_t chunk_count = GetQueryChunkCount<ExecutionPolicy>(ordinal_count);
+    const size_t chunk_size = ordinal_count / chunk_count + 1;
+    auto accumulator = accumulators.Acquire(ordinal_count);
+
+    // A minus word with more postings than all plus words together is cheaper to test per candidate
+    // against its set than to walk; the others have their postings excluded up front
+    size_t plus_posting_count = 0;
+    for (const ScoredPostings& term : query_postings.plus) {
+        plus_posting_count += term.postings.size;
+    }
+    std::vector<const OrdinalSet*> minus_sets;
+    std::vector<PostingSpan> walked_minus_postings;
+    for (const PostingSpan& postings : query_postings.minus) {
+        if (postings.ordinal_set && postings.size > plus_posting_count) {
+            minus_sets.push_back(postings.ordinal_set);
+        }
+        else {
+            walked_minus_postings.push_back(postings);
+        }
+    }
+
+    std::vector<std::vector<Document>> chunk_documents(chunk_count);
+    std::vector<size_t> chunk_indexes(chunk_count);
+    std::iota(chunk_indexes.begin(), chunk_indexes.end(), size_t{ 0 });
+    std::for_each(policy, chunk_indexes.begin(), chunk_indexes.end(), [&](size_t chunk) {
+        const DocumentOrdinal first = static_cast<DocumentOrdinal>(chunk * chunk_size);
+        const DocumentOrdinal last = static_cast<DocumentOrdinal>(std::min(ordinal_count, (chunk + 1) * chunk_size));
+
+        if (!walked_minus_postings.empty()) {
+            QueryStageTimer minus_timer(QueryStage::MINUS);
+            for (const PostingSpan& postings : walked_minus_postings) {
+                for (size_t i = postings.LowerBound(first); i < postings.size && postings.ordinals[i] < last; ++i) {
+                    accumulator->Exclude(postings.ordinals[i]);
+                }
+            }
+        }
+
+        QueryStageTimer traversal_timer(QueryStage::TRAVERSAL);
+        size_t postings_scanned = 0;
+        std::vector<DocumentOrdinal> matched_ordinals;
+        for (const auto& [postings, inverse_document_freq] : query_postings.plus) {
+            const size_t begin = postings.LowerBound(first);
+            size_t i = begin;
+            for (; i < postings.size && postings.ordinals[i] < last; ++i) {
+                const DocumentOrdinal ordinal = postings.ordinals[i];
+                switch (accumulator->GetState(ordinal)) {
+                case ScoreAccumulator::SlotState::SCORED:
+                    (*accumulator)[ordinal] += scorer.Score(postings, i, inverse_document_freq);
+                    break;
+                case ScoreAccumulator::SlotState::FREE: {
+                    if (!ContainsInAny(minus_sets, ordinal) && IsDocumentAdmitted(ordinal, get_document_info, document_predicate)) {
+                        accumulator->Start(ordinal, scorer.Score(postings, i, inverse_document_freq));
+                        matched_ordinals.push_back(ordinal);
+                    }
+                    else {
+                        accumulator->Exclude(ordinal);
+                    }
+                    break;
+                }
+                case ScoreAccumulator::SlotState::EXCLUDED:
+                    break;
+                }
+            }
+            postings_scanned += i - begin;
+        }
+        AddQueryCount(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+        AddQueryCount(QueryCounter::DOCUMENTS_MATCHED, matched_ordinals.size());
+
+        auto& documents = chunk_documents[chunk];
+        documents.reserve(matched_ordinals.size());
+        for (DocumentOrdinal ordinal : matched_ordinals) {
+            const DocumentInfo info = get_document_info(ordinal);
+            documents.push_back({ info.id, (*accumulator)[ordinal], info.rating });
+        }
+        });
+
+    if (chunk_count == 1) {
+        return std::move(chunk_documents.front());
+    }
+    std::vector<Document> matched_documents;
+    for (const auto& documents : chunk_documents) {
+        matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+    }
+    return matched_documents;
+}
+
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsPruned(ExecutionPolicy policy, const Scorer& scorer, QueryPostings query_postings,
+    size_t ordinal_count, size_t count, const std::optional<Document>& after,
+    DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate) {
+    std::vector<ScoredPostings>& terms = query_postings.plus;
+    std::sort(terms.begin(), terms.end(), [&scorer](const ScoredPostings& lhs, const ScoredPostings& rhs) {
+        return scorer.GetUpperBound(lhs.postings, lhs.inverse_document_freq)
+            < scorer.GetUpperBound(rhs.postings, rhs.inverse_document_freq);
+        });
+    std::vector<double> upper_bounds;
+    upper_bounds.reserve(terms.size());
+    for (const auto& [postings, inverse_document_freq] : terms) {
+        upper_bounds.push_back(scorer.GetUpperBound(postings, inverse_document_freq));
+    }
+
+    const size_t chunk_count = GetQueryChunkCount<ExecutionPolicy>(ordinal_count);
+    const size_t chunk_size = ordinal_count / chunk_count + 1;
+
+    std::vector<std::vector<Document>> chunk_documents(chunk_count);
+    std::vector<size_t> chunk_indexes(chunk_count);
+    std::iota(chunk_indexes.begin(), chunk_indexes.end(), size_t{ 0 });
+    std::for_each(policy, chunk_indexes.begin(), chunk_indexes.end(), [&](size_t chunk) {
+        const DocumentOrdinal first = static_cast<DocumentOrdinal>(chunk * chunk_size);
+        const DocumentOrdinal last = static_cast<DocumentOrdinal>(std::min(ordinal_count, (chunk + 1) * chunk_size));
+        QueryStageTimer traversal_timer(QueryStage::TRAVERSAL);
+        chunk_documents[chunk] = FindTopDocumentsInRange(scorer, terms, upper_bounds, query_postings.minus, first, last, count,
+            after, get_document_info, document_predicate);
+        });
+
+    QueryStageTimer top_k_timer(QueryStage::TOP_K);
+    std::vector<Document> top_documents = std::move(chunk_documents.front());
+    for (size_t chunk = 1; chunk < chunk_count; ++chunk) {
+        top_documents.insert(top_documents.end(), chunk_documents[chunk].begin(), chunk_documents[chunk].end());
+    }
+    SelectTopDocuments(std::execution::seq, top_documents, count);
+    return top_documents;
+}
+
+template <typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsInRange(const Scorer& scorer, const std::vector<ScoredPostings>& terms, const std::vector<double>& upper_bounds,
+    const std::vector<PostingSpan>& minus_postings, DocumentOrdinal first, DocumentOrdinal last, size_t count,
+    const std::optional<Document>& after, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate) {
+    std::vector<Document> top_documents;
+    if (count == 0) {
+        return top_documents;
+    }
+
+    const size_t term_count = terms.size();
+    std::vector<size_t> positions(term_count);
+    std::vector<size_t> ends(term_count);
+    for (size_t i = 0; i < term_count; ++i) {
+        positions[i] = terms[i].postings.LowerBound(first);
+        ends[i] = terms[i].postings.LowerBound(last);
+    }
+    std::vector<size_t> minus_positions(minus_postings.size());
+    for (size_t i = 0; i < minus_postings.size(); ++i) {
+        minus_positions[i] = minus_postings[i].LowerBound(first);
+    }
+    // bound_prefix[i] is the best total a document can get from terms [0, i)
+    std::vector<double> bound_prefix(term_count + 1, 0.0);
+    std::partial_sum(upper_bounds.begin(), upper_bounds.end(), bound_prefix.begin() + 1);
+
+    // Terms before first_essential cannot lift a document into the top on their own. Within a window
+    // the essential terms are summed posting by posting into window_scores, like the exhaustive walk;
+    // only their documents are candidates, and only candidates whose best total can still enter
+    // the top have the other terms probed. Near-ties within EPSILON are never pruned because rating may still decide them.
+    size_t first_essential = 0;
+    double threshold = 0.0;
+    size_t postings_scanned = 0;
+    size_t matched_count = 0;
+    auto cannot_enter = [&](double best_possible) {
+        return top_documents.size() == count && best_possible < threshold - EPSILON;
+    };
+    std::vector<double> window_scores(PRUNED_WINDOW_SIZE, 0.0);
+    std::vector<uint64_t> window_hits(PRUNED_WINDOW_SIZE / 64, 0);
+
+    while (true) {
+        // Windows start at the next essential posting, so stretches without one are skipped
+        DocumentOrdinal window_first = last;
+        for (size_t i = first_essential; i < term_count; ++i) {
+            if (positions[i] < ends[i]) {
+                window_first = std::min(window_first, terms[i].postings.ordinals[positions[i]]);
+            }
+        }
+        if (window_first == last) {
+            break;
+        }
+        const DocumentOrdinal window_last = last - window_first > PRUNED_WINDOW_SIZE
+            ? static_cast<DocumentOrdinal>(window_first + PRUNED_WINDOW_SIZE) : last;
+
+        const size_t window_first_essential = first_essential;
+        for (size_t i = window_first_essential; i < term_count; ++i) {
+            const PostingSpan& postings = terms[i].postings;
+            const double inverse_document_freq = terms[i].inverse_document_freq;
+            size_t pos = positions[i];
+            for (; pos < ends[i] && postings.ordinals[pos] < window_last; ++pos) {
+                const size_t slot = postings.ordinals[pos] - window_first;
+                window_scores[slot] += scorer.Score(postings, pos, inverse_document_freq);
+                window_hits[slot / 64] |= uint64_t{ 1 } << (slot % 64);
+            }
+            postings_scanned += pos - positions[i];
+            positions[i] = pos;
+        }
+
+        const size_t hit_word_count = (window_last - window_first + 63) / 64;
+        for (size_t word = 0; word < hit_word_count; ++word) {
+            uint64_t hits = window_hits[word];
+            window_hits[word] = 0;
+            while (hits != 0) {
+                const size_t slot = word * 64 + CountTrailingZeros(hits);
+                hits &= hits - 1;
+                double relevance = window_scores[slot];
+                window_scores[slot] = 0.0;
+                const DocumentOrdinal candidate = static_cast<DocumentOrdinal>(window_first + slot);
+
+                // Non-essential terms are probed from the highest bound down, so hopeless candidates drop out early
+                bool pruned = false;
+                for (size_t i = window_first_essential; i-- > 0;) {
+                    if (cannot_enter(relevance + bound_prefix[i + 1])) {
+                        pruned = true;
+                        break;
+                    }
+                    const PostingSpan& postings = terms[i].postings;
+                    positions[i] = postings.Advance(positions[i], candidate);
+                    if (positions[i] < ends[i] && postings.ordinals[positions[i]] == candidate) {
+                        relevance += scorer.Score(postings, positions[i], terms[i].inverse_document_freq);
+                        ++postings_scanned;
+                    }
+                }
+                if (pruned || cannot_enter(relevance)) {
+                    continue;
+                }
+
+                bool excluded = false;
+                for (size_t i = 0; i < minus_postings.size() && !excluded; ++i) {
+                    const PostingSpan& postings = minus_postings[i];
+                    if (postings.ordinal_set) {
+                        excluded = postings.ordinal_set->Contains(candidate);
+                        continue;
+                    }
+                    minus_positions[i] = postings.Advance(minus_positions[i], candidate);
+                    excluded = minus_positions[i] < postings.size && postings.ordinals[minus_positions[i]] == candidate;
+                }
+                if (excluded || !IsDocumentAdmitted(candidate, get_document_info, document_predicate)) {
+                    continue;
+                }
+                const DocumentInfo info = get_document_info(candidate);
+                const Document document(info.id, relevance, info.rating);
+                if (after && !IsMoreRelevant(*after, document)) {
+                    continue;
+                }
+                ++matched_count;
+
+                // The heap keeps the least relevant of the selected documents on top
+                if (top_documents.size() < count) {
+                    top_documents.push_back(document);
+                    std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                }
+                else if (IsMoreRelevant(document, top_documents.front())) {
+                    std::pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                    top_documents.back() = document;
+                    std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                }
+                // A raised threshold takes effect on the next window; this one is already summed
+                if (top_documents.size() == count) {
+                    threshold = top_documents.front().relevance;
+                    while (first_essential < term_count && cannot_enter(bound_prefix[first_essential + 1])) {
+                        ++first_essential;
+                    }
+                }
+            }
+        }
+    }
+    AddQueryCount(QueryCounter::POSTINGS_SCANNED, postings_scanned);
+    AddQueryCount(QueryCounter::DOCUMENTS_MATCHED, matched_count);
+    return top_documents;
+}
+
+template <typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsMatchingAll(const Scorer& scorer, const QueryPostings& query_postings, size_t count,
+    const std::optional<Document>& after, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate) {
+    if (query_postings.plus.empty() || query_postings.has_missing_plus_word) {
+        return {};
+    }
+    std::vector<PostingSpan> required;
+    required.reserve(query_postings.plus.size());
+    for (const ScoredPostings& term : query_postings.plus) {
+        required.push_back(term.postings);
+    }
+    return FindTopDocumentsIntersecting(scorer, query_postings, required, count, after,
+        [](DocumentOrdinal) { return true; }, get_document_info, document_predicate);
+}
+
+template <typename Scorer, typename ClauseMatcher, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsWithClauses(MatchMode match_mode, const Scorer& scorer, const QueryPostings& query_postings,
+    size_t count, const std::optional<Document>& after, ClauseMatcher matches_clauses,
+    DocumentInfoGetter get_document_info, DocumentPredicate document_predicate) {
+    if (query_postings.has_missing_required_word || (match_mode == MatchMode::ALL && query_postings.has_missing_plus_word)) {
+        return {};
+    }
+    std::vector<PostingSpan> required = query_postings.required;
+    if (match_mode == MatchMode::ALL) {
+        for (const ScoredPostings& term : query_postings.plus) {
+            required.push_back(term.postings);
+        }
+    }
+    // A word in several clauses, or also a plus word, is intersected once
+    std::sort(required.begin(), required.end(), [](const PostingSpan& lhs, const PostingSpan& rhs) { return lhs.ordinals < rhs.ordinals; });
+    required.erase(std::unique(required.begin(), required.end(),
+        [](const PostingSpan& lhs, const PostingSpan& rhs) { return lhs.ordinals == rhs.ordinals; }), required.end());
+    return FindTopDocumentsIntersecting(scorer, query_postings, required, count, after,
+        matches_clauses, get_document_info, document_predicate);
+}
+
+template <typename Scorer, typename CandidateFilter, typename DocumentInfoGetter, typename DocumentPredicate>
+std::vector<Document> FindTopDocumentsIntersecting(const Scorer& scorer, const QueryPostings& query_postings,
+    const std::vector<PostingSpan>& required, size_t count, const std::optional<Document>& after,
+    CandidateFilter is_candidate, DocumentInfoGetter& get_document_info, DocumentPredicate& document_predicate) {
+    std::vector<Document> top_documents;
+    const std::vector<ScoredPostings>& terms = query_postings.plus;
+    if (count == 0 || required.empty()) {
+        return top_documents;
+    }
+
+    // Spans of mapped snapshots carry no set; required words get one built, minus words are probed instead
+    std::vector<OrdinalSet> built_sets;
+    built_sets.reserve(required.size());
+    auto get_set = [&built_sets](const PostingSpan& postings) -> const OrdinalSet& {
+        if (postings.ordinal_set) {
+            return *postings.ordinal_set;
+        }
+        return built_sets.emplace_back(OrdinalSet::FromSorted(postings.ordinals, postings.ordinals + postings.size));
+    };
+    std::vector<size_t> order(required.size());
+    std::iota(order.begin(), order.end(), size_t{ 0 });
+    std::sort(order.begin(), order.end(), [&required](size_t lhs, size_t rhs) {
+        return required[lhs].size < required[rhs].size;
+        });
+    OrdinalSet candidates;
+    {
+        QueryStageTimer traversal_timer(QueryStage::TRAVERSAL);
+        candidates = get_set(required[order.front()]);
+        for (size_t i = 1; i < order.size() && !candidates.empty(); ++i) {
+            candidates = candidates.And(get_set(required[order[i]]));
+        }
+    }
+    std::vector<PostingSpan> probed_minus_postings;
+    if (!query_postings.minus.empty()) {
+        QueryStageTimer minus_timer(QueryStage::MINUS);
+        for (const PostingSpan& postings : query_postings.minus) {
+            if (postings.ordinal_set) {
+                candidates = candidates.AndNot(*postings.ordinal_set);
+            }
+            else {
+                probed_minus_postings.push_back(postings);
+            }
+        }
+    }
+
+    // Candidates ascend, so each term's position only moves forward. Filtering them is a pass of its own,
+    // so it is timed as the predicate stage, along with scoring the survivors.
+    size_t matched_count = 0;
+    std::vector<size_t> positions(terms.size(), 0);
+    {
+        QueryStageTimer predicate_timer(QueryStage::PREDICATE);
+        candidates.ForEach([&](DocumentOrdinal ordinal) {
+            if (std::any_of(probed_minus_postings.begin(), probed_minus_postings.end(),
+                [ordinal](const PostingSpan& postings) { return postings.Contains(ordinal); })) {
+                return;
+            }
+            if (!IsDocumentAdmitted(ordinal, get_document_info, document_predicate) || !is_candidate(ordinal)) {
+                return;
+            }
+            double relevance = 0.0;
+            for (size_t i = 0; i < terms.size(); ++i) {
+                const PostingSpan& postings = terms[i].postings;
+                positions[i] = std::lower_bound(postings.ordinals + positions[i], postings.ordinals + postings.size, ordinal) - postings.ordinals;
+                if (positions[i] < postings.size && postings.ordinals[positions[i]] == ordinal) {
+                    relevance += scorer.Score(postings, positions[i], terms[i].inverse_document_freq);
+                }
+            }
+            const DocumentInfo info = get_document_info(ordinal);
+            const Document document(info.id, relevance, info.rating);
+            if (after && !IsMoreRelevant(*after, document)) {
+                return;
+            }
+            ++matched_count;
+
+            // The heap keeps the least relevant of the selected documents on top
+            if (top_documents.size() < count) {
+                top_documents.push_back(document);
+                std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            }
+            else if (IsMoreRelevant(document, top_documents.front())) {
+                std::pop_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+                top_documents.back() = document;
+                std::push_heap(top_documents.begin(), top_documents.end(), IsMoreRelevant);
+            }
+            });
+    }
+    AddQueryCount(QueryCounter::POSTINGS_SCANNED, matched_count * terms.size());
+    AddQueryCount(QueryCounter::DOCUMENTS_MATCHED, matched_count);
+
+    QueryStageTimer top_k_timer(QueryStage::TOP_K);
+    SelectTopDocuments(std::execution::seq, top_documents, count);
+    return top_documents;
+}
+
+template <typename PostingsLookup>
+QueryBatch ParseQueryBatch(const std::vector<std::string>& raw_queries, const StopWords& stop_words, QuerySyntax syntax,
+    PostingsLookup find_postings) {
+    const uint32_t NO_BATCH_TERM = ~uint32_t{ 0 };
+    QueryBatch batch;
+    batch.plus_offsets.reserve(raw_queries.size() + 1);
+    batch.minus_offsets.reserve(raw_queries.size() + 1);
+    batch.plus_offsets.push_back(0);
+    batch.minus_offsets.push_back(0);
+
+    // Words missing from the index are remembered too, so they are not looked up again
+    std::unordered_map<std::string_view, uint32_t> term_indexes;
+    auto add_term = [&](std::string_view word, std::vector<uint32_t>& query_terms) {
+        auto [it, inserted] = term_indexes.emplace(word, NO_BATCH_TERM);
+        if (inserted) {
+            if (std::optional<ScoredPostings> postings = find_postings(word)) {
+                it->second = static_cast<uint32_t>(batch.terms.size());
+                batch.terms.push_back(*postings);
+            }
+        }
+        if (it->second != NO_BATCH_TERM) {
+            query_terms.push_back(it->second);
+        }
+    };
+
+    for (const std::string& raw_query : raw_queries) {
+        const Query query = ParseQuery(raw_query, stop_words, true, syntax);
+        batch.has_proximity_clauses |= !query.proximity_clauses.empty();
+        for (std::string_view word : query.plus_words) {
+            add_term(word, batch.plus_terms);
+        }
+        for (std::string_view word : query.minus_words) {
+            add_term(word, batch.minus_terms);
+        }
+        batch.plus_offsets.push_back(batch.plus_terms.size());
+        batch.minus_offsets.push_back(batch.minus_terms.size());
+    }
+    return batch;
+}
+
+template <typename ExecutionPolicy, typename Scorer, typename DocumentInfoGetter, typename DocumentPredicate>
+QueryBatchResults EvaluateQueryBatch(ExecutionPolicy policy, const Scorer& scorer, const QueryBatch& batch, size_t ordinal_count, size_t count,
+    ScoreAccumulatorPool& accumulators, DocumentInfoGetter get_document_info, DocumentPredicate document_predicate) {
+    const size_t query_count = batch.size();
+    QueryBatchResults results;
+    results.documents.resize(query_count * count);
+    results.offsets.resize(query_count + 1);
+    // Query i keeps a heap of its best documents in documents[i * count, i * count + heap_sizes[i])
+    std::vector<size_t> heap_sizes(query_count, 0);
+
+    const size_t group_count = count == 0 ? 0 : (query_count + QUERY_BATCH_GROUP_SIZE - 1) / QUERY_BATCH_GROUP_SIZE;
+    std::vector<size_t> group_indexes(group_count);
+    std::iota(group_indexes.begin(), group_indexes.end(), size_t{ 0 });
+    std::for_each(policy, group_indexes.begin(), group_indexes.end(), [&](size_t group) {
+        const size_t first_query = group * QUERY_BATCH_GROUP_SIZE;
+        const size_t last_query = std::min(query_count, first_query + QUERY_BATCH_GROUP_SIZE);
+
+        // Terms of the group renumbered densely, so per-block posting ranges fit in small arrays
+        const auto plus_first = batch.plus_terms.begin() + batch.plus_offsets[first_query];
+        const auto plus_last = batch.plus_terms.begin() + batch.plus_offsets[last_query];
+        const auto minus_first = batch.minus_terms.begin() + batch.minus_offsets[first_query];
+        const auto minus_last = batch.minus_terms.begin() + batch.minus_offsets[last_query];
+        std::vector<uint32_t> group_terms(plus_first, plus_last);
+        group_terms.insert(group_terms.end(), minus_first, minus_last);
+        std::sort(group_terms.begin(), group_terms.end());
+        group_terms.erase(std::unique(group_terms.begin(), group_terms.end()), group_terms.end());
+        auto to_group_term = [&group_terms](uint32_t term) {
+            return static_cast<uint32_t>(std::lower_bound(group_terms.begin(), group_terms.end(), term) - group_terms.begin());
+        };
+        std::vector<uint32_t> plus_terms(plus_last - plus_first);
+        std::transform(plus_first, plus_last, plus_terms.begin(), to_group_term);
+        std::vector<uint32_t> minus_terms(minus_last - minus_first);
+        std::transform(minus_first, minus_last, minus_terms.begin(), to_group_term);
+
+        // Postings of group term i that fall into the current block are [block_begins[i], block_ends[i])
+        std::vector<size_t> block_begins(group_terms.size(), 0);
+        std::vector<size_t> block_ends(group_terms.size(), 0);
+        auto accumulator = accumulators.Acquire(QUERY_BATCH_BLOCK_SIZE);
+        std::vector<DocumentOrdinal> matched_ordinals;
+
+        for (size_t block_first = 0; block_first < ordinal_count; block_first += QUERY_BATCH_BLOCK_SIZE) {
+            const DocumentOrdinal first = static_cast<DocumentOrdinal>(block_first);
+            const DocumentOrdinal last = static_cast<DocumentOrdinal>(std::min(ordinal_count, block_first + QUERY_BATCH_BLOCK_SIZE));
+            for (size_t i = 0; i < group_terms.size(); ++i) {
+                const PostingSpan& postings = batch.terms[group_terms[i]].postings;
+                block_begins[i] = block_ends[i];
+                block_ends[i] = std::lower_bound(postings.ordinals + block_begins[i], postings.ordinals + postings.size, last) - postings.ordinals;
+            }
+
+            for (size_t query = first_query; query < last_query; ++query) {
+                const size_t plus_begin = batch.plus_offsets[query] - batch.plus_offsets[first_query];
+                const size_t plus_end = batch.plus_offsets[query + 1] - batch.plus_offsets[first_query];
+                if (plus_begin == plus_end) {
+                    continue;
+                }
+                const size_t minus_begin = batch.minus_offsets[query] - batch.minus_offsets[first_query];
+                const size_t minus_end = batch.minus_offsets[query + 1] - batch.minus_offsets[first_query];
+
+                // Slots are indexed by the ordinal's offset in the block
+                accumulator->BeginQuery(QUERY_BATCH_BLOCK_SIZE);
+                for (size_t j = minus_begin; j < minus_end; ++j) {
+                    const uint32_t term = minus_terms[j];
+                    const PostingSpan& postings = batch.terms[group_terms[term]].postings;
+                    for (size_t i = block_begins[term]; i < block_ends[term]; ++i) {
+                        accumulator->Exclude(postings.ordinals[i] - first);
+                    }
+                }
+
+                matched_ordinals.clear();
+                for (size_t j = plus_begin; j < plus_end; ++j) {
+                    const uint32_t term = plus_terms[j];
+                    const auto& [postings, inverse_document_freq] = batch.terms[group_terms[term]];
+                    for (size_t i = block_begins[term]; i < block_ends[term]; ++i) {
+                        const DocumentOrdinal ordinal = postings.ordinals[i];
+                        const DocumentOrdinal slot = ordinal - first;
+                        switch (accumulator->GetState(slot)) {
+                        case ScoreAccumulator::SlotState::SCORED:
+                            (*accumulator)[slot] += scorer.Score(postings, i, inverse_document_freq);
+                            break;
+                        case ScoreAccumulator::SlotState::FREE: {
+                            if (IsDocumentAdmitted(ordinal, get_document_info, document_predicate)) {
+                                accumulator->Start(slot, scorer.Score(postings, i, inverse_document_freq));
+                                matched_ordinals.push_back(ordinal);
+                            }
+                            else {
+                                accumulator->Exclude(slot);
+                            }
+                            break;
+                        }
+                        case ScoreAccumulator::SlotState::EXCLUDED:
+                            break;
+                        }
+                    }
+                }
+
+                // The heap keeps the least relevant of the selected documents on top
+                const auto heap = results.documents.begin() + query * count;
+                size_t& heap_size = heap_sizes[query];
+                for (DocumentOrdinal ordinal : matched_ordinals) {
+                    const double relevance = (*accumulator)[ordinal - first];
+                    // Clearly worse than the whole heap: not worth fetching the rating
+                    if (heap_size == count && relevance < heap[0].relevance - EPSILON) {
+                        continue;
+                    }
+                    const DocumentInfo info = get_document_info(ordinal);
+                    const Document document(info.id, relevance, info.rating);
+                    if (heap_size < count) {
+                        heap[heap_size++] = document;
+                        std::push_heap(heap, heap + heap_size, IsMoreRelevant);
+                    }
+                    else if (IsMoreRelevant(document, heap[0])) {
+                        std::pop_heap(heap, heap + heap_size, IsMoreRelevant);
+                        heap[heap_size - 1] = document;
+                        std::push_heap(heap, heap + heap_size, IsMoreRelevant);
+                    }
+                }
+            }
+        }
+
+        for (size_t query = first_query; query < last_query; ++query) {
+            const auto heap = results.documents.begin() + query * count;
+            std::sort_heap(heap, heap + heap_sizes[query], IsMoreRelevant);
+        }
+        });
+
+    // Squeeze the unused slots out; every query moves down or stays in place
+    for (size_t query = 0; query < query_count; ++query) {
+        const auto heap = results.documents.begin() + query * count;
+        std::move(heap, heap + heap_sizes[query], results.documents.begin() + results.offsets[query]);
+        results.offsets[query + 1] = results.offsets[query] + heap_sizes[query];
+    }
+    results.documents.resize(results.offsets.back());
+    return results;
+}
+
+template <typename ExecutionPolicy, typename Searcher>
+QueryBatchResults FindTopDocumentsEach(ExecutionPolicy policy, const std::vector<std::string>& raw_queries, const Searcher& searcher) {
+    QueryBatchResults results;
+    results.offsets.reserve(raw_queries.size() + 1);
+    for (const std::string& raw_query : raw_queries) {
+        const std::vector<Document> documents = searcher.FindTopDocuments(policy, raw_query);
+        results.documents.insert(results.documents.end(), documents.begin(), documents.end());
+        results.offsets.push_back(results.documents.size());
+    }
+    return results;
+}
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <cmath>
+#include "bits.h"
+#include "query_stats.h"
+
+using namespace std;
+
+namespace {
+
+const uint64_t HALF_SUB_BUCKET_COUNT = uint64_t{ 1 } << (LATENCY_SUB_BUCKET_BITS - 1);
+
+// Slots are never freed: a thread that exits hands its slot over to the next new thread
+atomic<QueryStatsSlot*> query_stats_slots{ nullptr };
+
+QueryStatsSlot* AcquireQueryStatsSlot() {
+    for (QueryStatsSlot* slot = query_stats_slots.load(memory_order_acquire); slot; slot = slot->next) {
+        bool in_use = false;
+        if (!slot->in_use.load(memory_order_relaxed) && slot->in_use.compare_exchange_strong(in_use, true, memory_order_acquire)) {
+            return slot;
+        }
+    }
+    QueryStatsSlot* slot = new QueryStatsSlot();
+    slot->next = query_stats_slots.load(memory_order_relaxed);
+    while (!query_stats_slots.compare_exchange_weak(slot->next, slot, memory_order_release, memory_order_relaxed)) {
+    }
+    return slot;
+}
+
+struct QueryStatsSlotLease {
+    QueryStatsSlot* slot = AcquireQueryStatsSlot();
+
+    ~QueryStatsSlotLease() {
+        slot->in_use.store(false, memory_order_release);
+    }
+};
+
+}  // namespace
+
+size_t GetLatencyBucket(uint64_t nanoseconds) {
+    nanoseconds = min(nanoseconds, (uint64_t{ 1 } << LATENCY_MAX_BITS) - 1);
+    if (nanoseconds < (uint64_t{ 1 } << LATENCY_SUB_BUCKET_BITS)) {
+        return static_cast<size_t>(nanoseconds);
+    }
+    const int shift = GetHighestBit(nanoseconds) - (LATENCY_SUB_BUCKET_BITS - 1);
+    return static_cast<size_t>(shift * HALF_SUB_BUCKET_COUNT + (nanoseconds >> shift));
+}
+
+uint64_t GetLatencyBucketLimit(size_t bucket) {
+    if (bucket < (size_t{ 1 } << LATENCY_SUB_BUCKET_BITS)) {
+        return bucket;
+    }
+    const uint64_t shift = bucket / HALF_SUB_BUCKET_COUNT - 1;
+    const uint64_t lowest = (bucket % HALF_SUB_BUCKET_COUNT + HALF_SUB_BUCKET_COUNT) << shift;
+    return lowest + (uint64_t{ 1 } << shift) - 1;
+}
+
+uint64_t LatencyHistogram::GetQuantile(double share) const {
+    if (count == 0) {
+        return 0;
+    }
+    // Nearest rank
+    const uint64_t rank = max<uint64_t>(static_cast<uint64_t>(ceil(share * count)), 1);
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            return GetLatencyBucketLimit(bucket);
+        }
+    }
+    return GetLatencyBucketLimit(LATENCY_BUCKET_COUNT - 1);
+}
+
+double LatencyHistogram::GetMeanNanoseconds() const {
+    return count == 0 ? 0.0 : static_cast<double>(total_nanoseconds) / count;
+}
+
+LatencyHistogram& LatencyHistogram::operator-=(const LatencyHistogram& other) {
+    for (size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+        counts[bucket] -= other.counts[bucket];
+    }
+    count -= other.count;
+    total_nanoseconds -= other.total_nanoseconds;
+    return *this;
+}
+
+uint64_t QueryStats::Get(QueryCounter counter) const {
+    return counters[static_cast<size_t>(counter)];
+}
+
+const LatencyHistogram& QueryStats::Get(QueryStage stage) const {
+    return stages[static_cast<size_t>(stage)];
+}
+
+QueryStats& QueryStats::operator-=(const QueryStats& other) {
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+        counters[counter] -= other.counters[counter];
+    }
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+        stages[stage] -= other.stages[stage];
+    }
+    return *this;
+}
+
+QueryStats operator-(QueryStats lhs, const QueryStats& rhs) {
+    lhs -= rhs;
+    return lhs;
+}
+
+ostream& operator<<(ostream& os, const QueryStats& stats) {
+    static const char* const counter_names[QUERY_COUNTER_COUNT] = { "queries", "postings scanned", "documents matched" };
+    static const char* const stage_names[QUERY_STAGE_COUNT] = { "parse", "traversal", "predicate", "minus", "top-k" };
+    for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+        os << counter_names[counter] << ": " << stats.counters[counter] << "\n";
+    }
+    for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+        const LatencyHistogram& histogram = stats.stages[stage];
+        auto microseconds = [&histogram](double share) { return histogram.GetQuantile(share) / 1000.0; };
+        os << stage_names[stage] << ": " << histogram.count << " samples, mean " << histogram.GetMeanNanoseconds() / 1000.0
+            << " us, p50 " << microseconds(0.5) << ", p99 " << microseconds(0.99) << ", p999 " << microseconds(0.999)
+            << ", max " << microseconds(1.0) << " us\n";
+    }
+    return os;
+}
+
+QueryStats GetQueryStats() {
+    QueryStats stats;
+    for (const QueryStatsSlot* slot = query_stats_slots.load(memory_order_acquire); slot; slot = slot->next) {
+        for (size_t counter = 0; counter < QUERY_COUNTER_COUNT; ++counter) {
+            stats.counters[counter] += slot->counters[counter].load(memory_order_relaxed);
+        }
+        for (size_t stage = 0; stage < QUERY_STAGE_COUNT; ++stage) {
+            LatencyHistogram& histogram = stats.stages[stage];
+            for (size_t bucket = 0; bucket < LATENCY_BUCKET_COUNT; ++bucket) {
+                const uint64_t count = slot->buckets[stage][bucket].load(memory_order_relaxed);
+                histogram.counts[bucket] += count;
+                histogram.count += count;
+            }
+            histogram.total_nanoseconds += slot->total_nanoseconds[stage].load(memory_order_relaxed);
+        }
+    }
+    return stats;
+}
+
+QueryStatsSlot& GetThreadQueryStatsSlot() {
+    thread_local QueryStatsSlotLease lease;
+    return *lease.slot;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// Query instrumentation is on unless built with SEARCH_SERVER_QUERY_STATS=0, which turns
+// the timers and counters below into empty inline functions that compile away
+#ifndef SEARCH_SERVER_QUERY_STATS
+#define SEARCH_SERVER_QUERY_STATS 1
+#endif
+
+// Timed stages of a query. A stage records one sample per scope that runs it, so a parallel query
+// records one per task. Where filtering is fused into the posting walk it is counted as traversal.
+enum class QueryStage {
+    // Parsing and looking up the words
+    PARSE,
+    // Walking and scoring the plus postings
+    TRAVERSAL,
+    // Filtering candidates in a pass of their own, as after the intersection of MatchMode::ALL
+    PREDICATE,
+    // Excluding the documents of the minus words ahead of the walk
+    MINUS,
+    // Selecting and sorting the top documents
+    TOP_K,
+};
+
+const size_t QUERY_STAGE_COUNT = 5;
+
+enum class QueryCounter {
+    QUERIES,
+    POSTINGS_SCANNED,
+    // Documents that passed the minus words and the predicate and got a relevance
+    DOCUMENTS_MATCHED,
+};
+
+const size_t QUERY_COUNTER_COUNT = 3;
+
+// Durations in nanoseconds bucketed like HdrHistogram: exact below 2^LATENCY_SUB_BUCKET_BITS,
+// then each power of two is split into 2^(LATENCY_SUB_BUCKET_BITS - 1) buckets, which keeps
+// quantiles within about 3%. Longer durations than 2^LATENCY_MAX_BITS ns (about a minute) are clamped.
+const int LATENCY_SUB_BUCKET_BITS = 6;
+const int LATENCY_MAX_BITS = 36;
+const size_t LATENCY_BUCKET_COUNT = (LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 2) << (LATENCY_SUB_BUCKET_BITS - 1);
+
+size_t GetLatencyBucket(uint64_t nanoseconds);
+// Largest duration that falls into the bucket
+uint64_t GetLatencyBucketLimit(size_t bucket);
+
+struct LatencyHistogram {
+    std::array<uint64_t, LATENCY_BUCKET_COUNT> counts{};
+    uint64_t count = 0;
+    uint64_t total_nanoseconds = 0;
+
+    // share in [0, 1]; 0 for an empty histogram
+    uint64_t GetQuantile(double share) const;
+    double GetMeanNanoseconds() const;
+
+    LatencyHistogram& operator-=(const LatencyHistogram& other);
+};
+
+// Totals of every thread since the start of the process. Stats of an interval are the difference of two snapshots.
+struct QueryStats {
+    std::array<uint64_t, QUERY_COUNTER_COUNT> counters{};
+    std::array<LatencyHistogram, QUERY_STAGE_COUNT> stages;
+
+    uint64_t Get(QueryCounter counter) const;
+    const LatencyHistogram& Get(QueryStage stage) const;
+
+    QueryStats& operator-=(const QueryStats& other);
+};
+
+QueryStats operator-(QueryStats lhs, const QueryStats& rhs);
+
+// One line per counter and per stage with its count, mean and p50/p99/p999/max in microseconds
+std::ostream& operator<<(std::ostream& os, const QueryStats& stats);
+
+// Sums the per-thread records without stopping the threads that write them; empty when compiled out
+QueryStats GetQueryStats();
+
+// Records of one thread. Only that thread writes them, with plain loads and stores on relaxed atomics,
+// so recording never contends; GetQueryStats reads them concurrently. A thread's slot is reused by
+// a later thread once it exits, so its records keep counting towards the totals.
+struct QueryStatsSlot {
+    std::array<std::atomic<uint64_t>, QUERY_COUNTER_COUNT> counters{};
+    std::array<std::array<std::atomic<uint64_t>, LATENCY_BUCKET_COUNT>, QUERY_STAGE_COUNT> buckets{};
+    std::array<std::atomic<uint64_t>, QUERY_STAGE_COUNT> total_nanoseconds{};
+    std::atomic<bool> in_use{ true };
+    QueryStatsSlot* next = nullptr;
+};
+
+QueryStatsSlot& GetThreadQueryStatsSlot();
+
+inline void AddRelaxed(std::atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+#if SEARCH_SERVER_QUERY_STATS
+
+inline void AddQueryCount(QueryCounter counter, uint64_t value) {
+    AddRelaxed(GetThreadQueryStatsSlot().counters[static_cast<size_t>(counter)], value);
+}
+
+// Records the time from construction to the end of the scope as one sample of the stage
+class QueryStageTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit QueryStageTimer(QueryStage stage)
+        : stage_(stage) {
+    }
+    QueryStageTimer(const QueryStageTimer&) = delete;
+    QueryStageTimer& operator=(const QueryStageTimer&) = delete;
+
+    ~QueryStageTimer() {
+        const uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+        QueryStatsSlot& slot = GetThreadQueryStatsSlot();
+        const size_t stage = static_cast<size_t>(stage_);
+        AddRelaxed(slot.buckets[stage][GetLatencyBucket(nanoseconds)], 1);
+        AddRelaxed(slot.total_nanoseconds[stage], nanoseconds);
+    }
+
+private:
+    QueryStage stage_;
+    Clock::time_point start_ = Clock::now();
+};
+
+#else
+
+inline void AddQueryCount(QueryCounter, uint64_t) {
+}
+
+class QueryStageTimer {
+public:
+    explicit QueryStageTimer(QueryStage) {
+    }
+    QueryStageTimer(const QueryStageTimer&) = delete;
+    QueryStageTimer& operator=(const QueryStageTimer&) = delete;
+};
+
+#endif
@@ -1,27 +1,79 @@
 #include <algorithm>
-#include <iostream>
-#include <set>
-#include <utility>
+#include <limits>
 #include "remove_duplicates.h"
 
 using namespace std;
 
-void RemoveDuplicates(SearchServer& search_server) {
-    set<int> id_to_erase;
-    set<set<string>> set_of_docs_words;
-    for (auto id: search_server) {
-        set<string> doc_words;
-        for (const auto& [word,_]: search_server.GetWordFrequencies(id)){
-            doc_words.insert(word);     
+namespace {
+
+uint64_t MixBits(uint64_t value) {
+    // splitmix64 finalizer
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+}  // namespace
+
+// Entries are sorted by TermId, and a TermId stands for one word, so the sequence identifies the set
+uint64_t ComputeTermSetFingerprint(const WordFrequencies& word_freqs) {
+    uint64_t fingerprint = MixBits(word_freqs.size());
+    for (const TermFreq* entry = word_freqs.data(); entry != word_freqs.data() + word_freqs.size(); ++entry) {
+        fingerprint = MixBits(fingerprint ^ entry->term);
+    }
+    return fingerprint;
+}
+
+bool HaveSameTerms(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+    return equal(lhs.data(), lhs.data() + lhs.size(), rhs.data(), rhs.data() + rhs.size(),
+        [](const TermFreq& lhs_entry, const TermFreq& rhs_entry) { return lhs_entry.term == rhs_entry.term; });
+}
+
+MinHashSignature ComputeMinHashSignature(const WordFrequencies& word_freqs) {
+    MinHashSignature signature;
+    signature.fill(numeric_limits<uint64_t>::max());
+    for (const TermFreq* entry = word_freqs.data(); entry != word_freqs.data() + word_freqs.size(); ++entry) {
+        // One strong hash per term, then cheap independent permutations derived from it
+        const uint64_t hash = MixBits(entry->term);
+        for (size_t i = 0; i < MINHASH_SIGNATURE_SIZE; ++i) {
+            signature[i] = min(signature[i], MixBits(hash + i * 0x9e3779b97f4a7c15ULL));
         }
-        auto [_, is_inserted] = set_of_docs_words.insert(move(doc_words));
-        if (!is_inserted){
-            id_to_erase.insert(id);
-        }    
     }
-    for (auto id: id_to_erase){
-        std::cout<<"Found duplicate document id "<<id<<std::endl;
-        search_server.RemoveDocument(id);    
+    return signature;
+}
+
+double ComputeJaccardSimilarity(const WordFrequencies& lhs, const WordFrequencies& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t common = 0;
+    const TermFreq* lhs_it = lhs.data();
+    const TermFreq* rhs_it = rhs.data();
+    while (lhs_it != lhs.data() + lhs.size() && rhs_it != rhs.data() + rhs.size()) {
+        if (lhs_it->term < rhs_it->term) {
+            ++lhs_it;
+        }
+        else if (rhs_it->term < lhs_it->term) {
+            ++rhs_it;
+        }
+        else {
+            ++common;
+            ++lhs_it;
+            ++rhs_it;
+        }
     }
-    
+    return static_cast<double>(common) / (lhs.size() + rhs.size() - common);
+}
+
+vector<int> FindDuplicates(const SearchServer& search_server) {
+    return FindDuplicates(execution::seq, search_server);
+}
+
+vector<int> RemoveDuplicates(SearchServer& search_server) {
+    vector<int> duplicates = FindDuplicates(execution::par, search_server);
+    search_server.RemoveDocuments(execution::par, duplicates);
+    return duplicates;
 }
@@ -1,5 +1,159 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <execution>
+#include <numeric>
 #include <string>
+#include <utility>
+#include <vector>
+#include "forward_index.h"
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
+// MinHash values per document; split into bands of MINHASH_BAND_ROWS values for locality-sensitive hashing.
+// Two documents with Jaccard similarity s share a band with probability 1 - (1 - s^4)^16: 0.99 for s = 0.7.
+const size_t MINHASH_SIGNATURE_SIZE = 64;
+const size_t MINHASH_BAND_ROWS = 4;
+// Earliest documents of a band bucket that each later one is checked against. A bucket can hold most of the corpus
+// when documents share most of their words, and checking every pair of it would be quadratic.
+const size_t MINHASH_MAX_BUCKET_CANDIDATES = 64;
+
+using MinHashSignature = std::array<uint64_t, MINHASH_SIGNATURE_SIZE>;
+
+// Hash of the set of terms; equal sets give equal fingerprints
+uint64_t ComputeTermSetFingerprint(const WordFrequencies& word_freqs);
+bool HaveSameTerms(const WordFrequencies& lhs, const WordFrequencies& rhs);
+MinHashSignature ComputeMinHashSignature(const WordFrequencies& word_freqs);
+// Share of distinct words the documents have in common
+double ComputeJaccardSimilarity(const WordFrequencies& lhs, const WordFrequencies& rhs);
+
+// Ids of documents whose set of words equals that of a document with a smaller id, ascending.
+// Documents are compared by fingerprint; equal fingerprints are confirmed term by term.
+template <typename ExecutionPolicy>
+std::vector<int> FindDuplicates(ExecutionPolicy&& policy, const SearchServer& search_server);
+std::vector<int> FindDuplicates(const SearchServer& search_server);
+
+// Also reports documents whose word sets have a Jaccard similarity of at least min_similarity
+// with a smaller-id document that is itself kept. Candidates come from MinHash bands and are checked exactly,
+// so no pair below the threshold is reported; rare pairs that share no band, or only crowded buckets
+// past their first MINHASH_MAX_BUCKET_CANDIDATES documents, are missed.
+template <typename ExecutionPolicy>
+std::vector<int> FindNearDuplicates(ExecutionPolicy&& policy, const SearchServer& search_server, double min_similarity);
+
+// Removes what FindDuplicates reports and returns the removed ids
+std::vector<int> RemoveDuplicates(SearchServer& search_server);
+
+/*********************************************************************************/
+template <typename ExecutionPolicy>
+std::vector<int> FindDuplicates(ExecutionPolicy&& policy, const SearchServer& search_server) {
+    const std::vector<int> document_ids(search_server.begin(), search_server.end());
+    std::vector<std::pair<uint64_t, size_t>> fingerprints(document_ids.size());
+    std::vector<size_t> indexes(document_ids.size());
+    std::iota(indexes.begin(), indexes.end(), size_t{ 0 });
+    std::transform(policy, indexes.begin(), indexes.end(), fingerprints.begin(), [&](size_t i) {
+        return std::pair{ ComputeTermSetFingerprint(search_server.GetWordFrequencies(document_ids[i])), i };
+        });
+    // Within a run of equal fingerprints the smallest id comes first
+    std::sort(policy, fingerprints.begin(), fingerprints.end());
+
+    std::vector<int> duplicates;
+    std::vector<WordFrequencies> kept;
+    for (size_t first = 0; first < fingerprints.size();) {
+        size_t last = first;
+        kept.clear();
+        for (; last < fingerprints.size() && fingerprints[last].first == fingerprints[first].first; ++last) {
+            const int document_id = document_ids[fingerprints[last].second];
+            const WordFrequencies word_freqs = search_server.GetWordFrequencies(document_id);
+            // Almost always a single set per fingerprint, unless the hash collided
+            if (std::any_of(kept.begin(), kept.end(), [&](const WordFrequencies& other) { return HaveSameTerms(word_freqs, other); })) {
+                duplicates.push_back(document_id);
+            }
+            else {
+                kept.push_back(word_freqs);
+            }
+        }
+        first = last;
+    }
+    std::sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+template <typename ExecutionPolicy>
+std::vector<int> FindNearDuplicates(ExecutionPolicy&& policy, const SearchServer& search_server, double min_similarity) {
+    constexpr size_t band_count = MINHASH_SIGNATURE_SIZE / MINHASH_BAND_ROWS;
+    const std::vector<int> exact_duplicates = FindDuplicates(policy, search_server);
+
+    // Exact duplicates are reported anyway; documents without words have no signature
+    std::vector<int> document_ids;
+    for (const int document_id : search_server) {
+        if (!std::binary_search(exact_duplicates.begin(), exact_duplicates.end(), document_id)
+            && !search_server.GetWordFrequencies(document_id).empty()) {
+            document_ids.push_back(document_id);
+        }
+    }
+    std::vector<MinHashSignature> signatures(document_ids.size());
+    std::transform(policy, document_ids.begin(), document_ids.end(), signatures.begin(), [&](int document_id) {
+        return ComputeMinHashSignature(search_server.GetWordFrequencies(document_id));
+        });
+
+    // (band hash, document index) sorted, so documents sharing a band are neighbours
+    std::vector<std::pair<uint64_t, size_t>> band_keys(document_ids.size() * band_count);
+    std::vector<size_t> indexes(document_ids.size());
+    std::iota(indexes.begin(), indexes.end(), size_t{ 0 });
+    std::for_each(policy, indexes.begin(), indexes.end(), [&](size_t i) {
+        for (size_t band = 0; band < band_count; ++band) {
+            uint64_t key = band;
+            for (size_t row = band * MINHASH_BAND_ROWS; row < (band + 1) * MINHASH_BAND_ROWS; ++row) {
+                key = (key ^ signatures[i][row]) * 0x100000001b3ULL;
+            }
+            band_keys[i * band_count + band] = { key, i };
+        }
+        });
+    std::sort(policy, band_keys.begin(), band_keys.end());
+
+    std::vector<std::pair<size_t, size_t>> candidates;
+    for (size_t first = 0; first < band_keys.size();) {
+        size_t last = first + 1;
+        for (; last < band_keys.size() && band_keys[last].first == band_keys[first].first; ++last) {
+            for (size_t other = first; other < std::min(last, first + MINHASH_MAX_BUCKET_CANDIDATES); ++other) {
+                // Bands of one document may collide with each other
+                if (band_keys[other].second != band_keys[last].second) {
+                    candidates.emplace_back(band_keys[other].second, band_keys[last].second);
+                }
+            }
+        }
+        first = last;
+    }
+    std::sort(policy, candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<char> similar(candidates.size());
+    std::transform(policy, candidates.begin(), candidates.end(), similar.begin(), [&](const std::pair<size_t, size_t>& candidate) {
+        return ComputeJaccardSimilarity(search_server.GetWordFrequencies(document_ids[candidate.first]),
+            search_server.GetWordFrequencies(document_ids[candidate.second])) >= min_similarity;
+        });
+
+    // Pairs go by their later document, so whether the earlier one is kept is settled before it is consulted
+    std::vector<std::pair<size_t, size_t>> similar_pairs;
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (similar[i]) {
+            similar_pairs.emplace_back(candidates[i].second, candidates[i].first);
+        }
+    }
+    std::sort(similar_pairs.begin(), similar_pairs.end());
+    std::vector<char> is_duplicate(document_ids.size(), false);
+    for (const auto& [later, earlier] : similar_pairs) {
+        if (!is_duplicate[earlier]) {
+            is_duplicate[later] = true;
+        }
+    }
+
+    std::vector<int> duplicates = exact_duplicates;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        if (is_duplicate[i]) {
+            duplicates.push_back(document_ids[i]);
+        }
+    }
+    std::sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
@@ -2,40 +2,37 @@
 #include "request_queue.h"
 using namespace std;
 
-RequestQueue::RequestQueue(const SearchServer& search_server)
+RequestQueue::RequestQueue(const SearchServer& search_server, chrono::seconds window)
     : search_server_(search_server)
-    , no_results_requests_(0)
-    , current_time_(0) {
+    , stats_(window) {
 }
 
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) {
-    const auto result = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(result.size());
-    return result;
+RequestQueue::RequestQueue(const SearchServer& search_server, QueryCache& cache, chrono::seconds window)
+    : RequestQueue(search_server, window) {
+    cache_ = &cache;
 }
 
-vector<Document> RequestQueue::AddFindRequest(const string& raw_query) {
-    const auto result = search_server_.FindTopDocuments(raw_query);
-    AddRequest(result.size());
+vector<Document> RequestQueue::AddFindRequest(const string& raw_query, DocumentStatus status) const {
+    const auto start = RequestStats::Clock::now();
+    const auto result = cache_ ? FindTopDocumentsCached(search_server_, *cache_, raw_query, status)
+        : search_server_.FindTopDocuments(raw_query, status);
+    AddRequest(start, result.size());
     return result;
 }
 
+vector<Document> RequestQueue::AddFindRequest(const string& raw_query) const {
+    return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
+}
+
 int RequestQueue::GetNoResultRequests() const {
-    return no_results_requests_;
+    return static_cast<int>(stats_.GetStats().no_result_count);
 }
 
-void RequestQueue::AddRequest(int results_num) {
-    ++current_time_;
-    // удаляем все результаты поиска, которые устарели
-    while (!requests_.empty() && min_in_day_ <= current_time_ - requests_.front().timestamp) {
-        if (0 == requests_.front().results) {
-            --no_results_requests_;
-        }
-        requests_.pop_front();
-    }
-    // сохраняем новый результат поиска
-    requests_.push_back({current_time_, results_num});
-    if (0 == results_num) {
-        ++no_results_requests_;
-    }
-}
\ No newline at end of file
+RequestWindowStats RequestQueue::GetStats() const {
+    return stats_.GetStats();
+}
+
+void RequestQueue::AddRequest(RequestStats::Clock::time_point start, size_t results_num) const {
+    const auto finish = RequestStats::Clock::now();
+    stats_.Record(finish, results_num, finish - start);
+}
@@ -1,38 +1,43 @@
 #pragma once
+#include <chrono>
+#include <string>
 #include <vector>
-#include <deque>
 #include "document.h"
+#include "query_cache.h"
+#include "request_stats.h"
 #include "search_server.h"
+// Answers requests and keeps statistics of those of the last window of wall-clock time.
+// Requests may come from many threads at once.
 class RequestQueue {
     
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    explicit RequestQueue(const SearchServer& search_server, std::chrono::seconds window = REQUEST_STATS_WINDOW);
+    // Requests by status are answered through the cache
+    RequestQueue(const SearchServer& search_server, QueryCache& cache, std::chrono::seconds window = REQUEST_STATS_WINDOW);
     // сделаем "обертки" для всех методов поиска, чтобы сохранять результаты для нашей статистики
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status) const;
+    std::vector<Document> AddFindRequest(const std::string& raw_query) const;
                                          
+    // Requests of the window that found nothing
     int GetNoResultRequests() const;
+    RequestWindowStats GetStats() const;
     
 private:
-    struct QueryResult {
-        uint64_t timestamp;
-        int results;
-    };
-    std::deque<QueryResult> requests_;
     const SearchServer& search_server_;
-    int no_results_requests_;
-    uint64_t current_time_;
-    const static int min_in_day_ = 1440;
+    QueryCache* cache_ = nullptr;
+    // Recording is thread-safe, so const requests may share it
+    mutable RequestStats stats_;
 
-    void AddRequest(int results_num);
+    void AddRequest(RequestStats::Clock::time_point start, size_t results_num) const;
 };
 
 
 template <typename DocumentPredicate>
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) const {
+    const auto start = RequestStats::Clock::now();
     const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    AddRequest(result.size());
+    AddRequest(start, result.size());
     return result;
 }
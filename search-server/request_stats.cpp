@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include "request_stats.h"
+
+using namespace std;
+
+namespace {
+
+const int SECOND_SHIFT = 32;
+const uint64_t COUNT_MASK = (uint64_t{ 1 } << SECOND_SHIFT) - 1;
+
+// Adds one to a counter of the second, restarting it if it still counts an older one
+void AddToCounter(atomic<uint64_t>& counter, uint64_t second) {
+    uint64_t value = counter.load(memory_order_relaxed);
+    while (true) {
+        const uint64_t counter_second = value >> SECOND_SHIFT;
+        if (counter_second == second) {
+            counter.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        if (counter_second > second) {
+            return;
+        }
+        if (counter.compare_exchange_weak(value, (second << SECOND_SHIFT) | 1, memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+uint64_t ReadCounter(const atomic<uint64_t>& counter, uint64_t second) {
+    const uint64_t value = counter.load(memory_order_relaxed);
+    return (value >> SECOND_SHIFT) == second ? value & COUNT_MASK : 0;
+}
+
+size_t GetBucketCount(chrono::seconds window) {
+    if (window.count() <= 0) {
+        throw invalid_argument("window must be at least a second");
+    }
+    return static_cast<size_t>(window.count());
+}
+
+size_t GetThreadStripe() {
+    thread_local const size_t stripe = hash<thread::id>{}(this_thread::get_id()) % REQUEST_STATS_STRIPE_COUNT;
+    return stripe;
+}
+
+}  // namespace
+
+RequestStats::RequestStats(chrono::seconds window, Clock::time_point start)
+    : start_(start)
+    , bucket_count_(GetBucketCount(window))
+    , buckets_(make_unique<Bucket[]>(bucket_count_)) {
+}
+
+void RequestStats::Record(Clock::time_point finish, size_t result_count, Clock::duration latency) {
+    const uint64_t second = GetSecond(finish);
+    Stripe& stripe = buckets_[second % bucket_count_].stripes[GetThreadStripe()];
+    AddToCounter(stripe.requests, second);
+    if (result_count == 0) {
+        AddToCounter(stripe.no_results, second);
+    }
+    const uint64_t nanoseconds = chrono::duration_cast<chrono::nanoseconds>(max(latency, Clock::duration::zero())).count();
+    AddToCounter(stripe.latencies[GetLatencyBucket(nanoseconds)], second);
+}
+
+RequestWindowStats RequestStats::GetStats(Clock::time_point now) const {
+    const uint64_t last_second = GetSecond(now);
+    const uint64_t first_second = last_second > bucket_count_ ? last_second - bucket_count_ + 1 : 1;
+    RequestWindowStats stats;
+    LatencyHistogram latencies;
+    for (uint64_t second = first_second; second <= last_second; ++second) {
+        const Bucket& bucket = buckets_[second % bucket_count_];
+        for (const Stripe& stripe : bucket.stripes) {
+            stats.request_count += ReadCounter(stripe.requests, second);
+            stats.no_result_count += ReadCounter(stripe.no_results, second);
+            for (size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i) {
+                const uint64_t count = ReadCounter(stripe.latencies[i], second);
+                latencies.counts[i] += count;
+                latencies.count += count;
+            }
+        }
+    }
+    // The current second has only partly elapsed, so count just that part of it
+    const Clock::time_point window_start = start_ + chrono::seconds(first_second - 1);
+    const double elapsed_seconds = chrono::duration<double>(now - window_start).count();
+    stats.requests_per_second = elapsed_seconds > 0.0 ? stats.request_count / elapsed_seconds : 0.0;
+    stats.p50_nanoseconds = latencies.GetQuantile(0.5);
+    stats.p99_nanoseconds = latencies.GetQuantile(0.99);
+    stats.p999_nanoseconds = latencies.GetQuantile(0.999);
+    stats.max_nanoseconds = latencies.GetQuantile(1.0);
+    return stats;
+}
+
+RequestWindowStats RequestStats::GetStats() const {
+    return GetStats(Clock::now());
+}
+
+uint64_t RequestStats::GetSecond(Clock::time_point time) const {
+    if (time < start_) {
+        return 1;
+    }
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::seconds>(time - start_).count()) + 1;
+}
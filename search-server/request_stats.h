@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "query_stats.h"
+
+// Stripes of the counters and latency histogram of a second; each thread adds to its own, so threads do not share cache lines
+const size_t REQUEST_STATS_STRIPE_COUNT = 8;
+const std::chrono::seconds REQUEST_STATS_WINDOW{ 60 };
+
+// Requests of the last window, the current second included
+struct RequestWindowStats {
+    uint64_t request_count = 0;
+    uint64_t no_result_count = 0;
+    // Divided by the time the window actually covers: its full seconds plus the elapsed part of the current one
+    double requests_per_second = 0.0;
+    // Upper bounds within about 3%, see LatencyHistogram
+    uint64_t p50_nanoseconds = 0;
+    uint64_t p99_nanoseconds = 0;
+    uint64_t p999_nanoseconds = 0;
+    uint64_t max_nanoseconds = 0;
+};
+
+// Sliding wall-clock window over a ring of per-second buckets. Any number of threads may record and read at once.
+// Every counter holds the second it counts in its high half, so the first writer of a new second
+// restarts it with a single CAS and readers skip counters left from an older second: nothing is ever locked or cleared.
+class RequestStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestStats(std::chrono::seconds window = REQUEST_STATS_WINDOW, Clock::time_point start = Clock::now());
+
+    // Requests older than the window by the time they are recorded are dropped
+    void Record(Clock::time_point finish, size_t result_count, Clock::duration latency);
+    RequestWindowStats GetStats(Clock::time_point now) const;
+    RequestWindowStats GetStats() const;
+
+private:
+    struct alignas(64) Stripe {
+        std::atomic<uint64_t> requests{ 0 };
+        std::atomic<uint64_t> no_results{ 0 };
+        std::array<std::atomic<uint64_t>, LATENCY_BUCKET_COUNT> latencies{};
+    };
+
+    struct Bucket {
+        std::array<Stripe, REQUEST_STATS_STRIPE_COUNT> stripes;
+    };
+
+    Clock::time_point start_;
+    size_t bucket_count_;
+    std::unique_ptr<Bucket[]> buckets_;
+
+    // 1 for the first second after the start; 0 marks a counter never written
+    uint64_t GetSecond(Clock::time_point time) const;
+};
@@ -0,0 +1,38 @@
+#include <algorithm>
+#include <limits>
+#include "score_accumulator.h"
+
+using namespace std;
+
+void ScoreAccumulator::BeginQuery(size_t ordinal_count) {
+    if (stamps_.size() < ordinal_count) {
+        stamps_.resize(ordinal_count, 0);
+        scores_.resize(ordinal_count, 0.0);
+    }
+    epoch_ += 2;
+    if (epoch_ >= numeric_limits<uint32_t>::max() - 1) {
+        fill(stamps_.begin(), stamps_.end(), 0);
+        epoch_ = 2;
+    }
+}
+
+ScoreAccumulatorPool::Handle ScoreAccumulatorPool::Acquire(size_t ordinal_count) {
+    unique_ptr<ScoreAccumulator> accumulator;
+    {
+        lock_guard guard(mutex_);
+        if (!free_.empty()) {
+            accumulator = move(free_.back());
+            free_.pop_back();
+        }
+    }
+    if (!accumulator) {
+        accumulator = make_unique<ScoreAccumulator>();
+    }
+    accumulator->BeginQuery(ordinal_count);
+    return { *this, move(accumulator) };
+}
+
+void ScoreAccumulatorPool::Release(unique_ptr<ScoreAccumulator> accumulator) {
+    lock_guard guard(mutex_);
+    free_.push_back(move(accumulator));
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "inverted_index.h"
+
+// Dense per-query relevance storage indexed by document ordinal.
+// A slot belongs to the current query only if its stamp matches, so nothing is cleared between queries.
+// Writers that work on disjoint ordinal ranges never touch the same slot and need no synchronisation.
+class ScoreAccumulator {
+public:
+    enum class SlotState {
+        FREE,
+        SCORED,
+        EXCLUDED,
+    };
+
+    void BeginQuery(size_t ordinal_count);
+
+    SlotState GetState(DocumentOrdinal ordinal) const {
+        const uint32_t stamp = stamps_[ordinal];
+        if (stamp == epoch_) {
+            return SlotState::SCORED;
+        }
+        return stamp == epoch_ + 1 ? SlotState::EXCLUDED : SlotState::FREE;
+    }
+
+    void Start(DocumentOrdinal ordinal, double score) {
+        stamps_[ordinal] = epoch_;
+        scores_[ordinal] = score;
+    }
+    void Exclude(DocumentOrdinal ordinal) {
+        stamps_[ordinal] = epoch_ + 1;
+    }
+    double& operator[](DocumentOrdinal ordinal) {
+        return scores_[ordinal];
+    }
+    double operator[](DocumentOrdinal ordinal) const {
+        return scores_[ordinal];
+    }
+
+private:
+    std::vector<uint32_t> stamps_;
+    std::vector<double> scores_;
+    // Scored slots carry epoch_, excluded ones epoch_ + 1
+    uint32_t epoch_ = 0;
+};
+
+// Keeps accumulators of finished queries for reuse. Copies of a pool start empty.
+class ScoreAccumulatorPool {
+public:
+    class Handle {
+    public:
+        Handle(ScoreAccumulatorPool& pool, std::unique_ptr<ScoreAccumulator> accumulator)
+            : pool_(pool)
+            , accumulator_(std::move(accumulator)) {
+        }
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        ~Handle() {
+            pool_.Release(std::move(accumulator_));
+        }
+
+        ScoreAccumulator& operator*() const {
+            return *accumulator_;
+        }
+        ScoreAccumulator* operator->() const {
+            return accumulator_.get();
+        }
+
+    private:
+        ScoreAccumulatorPool& pool_;
+        std::unique_ptr<ScoreAccumulator> accumulator_;
+    };
+
+    ScoreAccumulatorPool() = default;
+    ScoreAccumulatorPool(const ScoreAccumulatorPool&) {
+    }
+    ScoreAccumulatorPool& operator=(const ScoreAccumulatorPool&) {
+        return *this;
+    }
+
+    // The returned accumulator is already prepared for a query over ordinal_count documents
+    Handle Acquire(size_t ordinal_count);
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<ScoreAccumulator>> free_;
+
+    void Release(std::unique_ptr<ScoreAccumulator> accumulator);
+};
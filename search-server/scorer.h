@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "inverted_index.h"
+
+const double BM25_K1 = 1.2;
+const double BM25_B = 0.75;
+
+enum class RankingFunction {
+    TF_IDF,
+    BM25,
+};
+
+// Scorers turn a posting into its share of a document's relevance. Query evaluation takes the scorer as
+// a template parameter, so Score is inlined into the accumulation loops. No posting of a term may score
+// above GetUpperBound, which MaxScore pruning relies on.
+
+// Stored term frequency (occurrences over document length) times IDF
+struct TfIdfScorer {
+    double Score(const PostingSpan& postings, size_t i, double inverse_document_freq) const {
+        return postings.term_freqs[i] * inverse_document_freq;
+    }
+    double GetUpperBound(const PostingSpan& postings, double inverse_document_freq) const {
+        return postings.max_term_freq * inverse_document_freq;
+    }
+};
+
+// Okapi BM25 over the same IDF: occurrences saturate with k1, and b weighs them against the document's length
+// relative to the average. Occurrences are recovered from the stored frequency as term_freq * word count.
+struct Bm25Scorer {
+    // Indexed by ordinal
+    const uint32_t* word_counts = nullptr;
+    double average_word_count = 1.0;
+    double k1 = BM25_K1;
+    double b = BM25_B;
+
+    double Score(const PostingSpan& postings, size_t i, double inverse_document_freq) const {
+        const double word_count = word_counts[postings.ordinals[i]];
+        const double occurrences = postings.term_freqs[i] * word_count;
+        return inverse_document_freq * occurrences * (k1 + 1)
+            / (occurrences + k1 * (1 - b + b * word_count / average_word_count));
+    }
+    // With the term frequency fixed, the score grows with the document's length; its limit for endless documents
+    // at the largest frequency of the list bounds every posting
+    double GetUpperBound(const PostingSpan& postings, double inverse_document_freq) const {
+        return inverse_document_freq * (k1 + 1) * postings.max_term_freq
+            / (postings.max_term_freq + k1 * b / average_word_count);
+    }
+};
@@ -0,0 +1,65 @@
+#include <cstring>
+#include <stdexcept>
+#include "search_cursor.h"
+
+using namespace std;
+
+namespace {
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+const size_t TOKEN_LENGTH = 2 * (sizeof(uint64_t) * 3 + sizeof(uint32_t) * 2);
+
+void AppendHex(string& token, uint64_t value, size_t byte_count) {
+    for (size_t i = byte_count * 2; i-- > 0;) {
+        token.push_back(HEX_DIGITS[(value >> (i * 4)) & 0xF]);
+    }
+}
+
+uint64_t ReadHex(string_view& token, size_t byte_count) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < byte_count * 2; ++i) {
+        const char c = token[i];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        }
+        else {
+            throw invalid_argument("malformed search cursor");
+        }
+        value = (value << 4) | static_cast<uint64_t>(digit);
+    }
+    token.remove_prefix(byte_count * 2);
+    return value;
+}
+
+}  // namespace
+
+string SearchCursor::ToString() const {
+    uint64_t relevance_bits;
+    memcpy(&relevance_bits, &last.relevance, sizeof(relevance_bits));
+    string token;
+    token.reserve(TOKEN_LENGTH);
+    AppendHex(token, generation, sizeof(uint64_t));
+    AppendHex(token, query_hash, sizeof(uint64_t));
+    AppendHex(token, relevance_bits, sizeof(uint64_t));
+    AppendHex(token, static_cast<uint32_t>(last.rating), sizeof(uint32_t));
+    AppendHex(token, static_cast<uint32_t>(last.id), sizeof(uint32_t));
+    return token;
+}
+
+SearchCursor SearchCursor::Parse(string_view token) {
+    if (token.size() != TOKEN_LENGTH) {
+        throw invalid_argument("malformed search cursor");
+    }
+    SearchCursor cursor;
+    cursor.generation = ReadHex(token, sizeof(uint64_t));
+    cursor.query_hash = ReadHex(token, sizeof(uint64_t));
+    const uint64_t relevance_bits = ReadHex(token, sizeof(uint64_t));
+    memcpy(&cursor.last.relevance, &relevance_bits, sizeof(relevance_bits));
+    cursor.last.rating = static_cast<int>(static_cast<uint32_t>(ReadHex(token, sizeof(uint32_t))));
+    cursor.last.id = static_cast<int>(static_cast<uint32_t>(ReadHex(token, sizeof(uint32_t))));
+    return cursor;
+}
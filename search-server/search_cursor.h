@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "document.h"
+
+// Where a page of search results ended: the last document returned, plus what the next page must match,
+// so that a token cannot resume another query or outlive the index state it was computed on
+struct SearchCursor {
+    uint64_t generation = 0;
+    uint64_t query_hash = 0;
+    Document last;
+
+    // Opaque token of hex digits
+    std::string ToString() const;
+    // Throws invalid_argument for anything ToString did not produce
+    static SearchCursor Parse(std::string_view token);
+};
+
+struct SearchPage {
+    std::vector<Document> documents;
+    // Empty once there are no more results
+    std::string next_cursor;
+};
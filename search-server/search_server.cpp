@@ -7,189 +7,442 @@ using namespace std;
 SearchServer::SearchServer(const string& stop_words_text)
     :SearchServer(string_view(stop_words_text)) {}
 
-SearchServer::SearchServer(string_view stop_words_text)
-    : SearchServer(SplitIntoWords(stop_words_text)) {}  // Invoke delegating constructor from string_view container
+// One validating pass over the text, rather than a split and then a check of every word
+SearchServer::SearchServer(string_view stop_words_text) {
+    for (string_view word : SplitIntoValidWords(stop_words_text)) {
+        stop_words_.emplace(word);
+    }
+}
 
 void SearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
     if (documents_.count(document_id) != 0) throw invalid_argument("document id already exists");//check document id
     if (document_id < 0) throw invalid_argument("negative document id");  //check document id
 
-    const vector<string_view> words = SplitIntoWordsNoStop(document);
-    const double inv_word_count = 1.0 / words.size();
-    map<string_view, double>& word_to_freq = document_id_to_word_freqs_[document_id];
-    for (string_view word : words) {
-        auto word_in_storage_it = storage.insert(string(word)).first;
-        word_to_document_freqs_[*word_in_storage_it][document_id] += inv_word_count;
-        word_to_freq[*word_in_storage_it] += inv_word_count;
+    vector<uint32_t> positions;
+    const vector<string_view> words = SplitIntoWordsNoStop(document, positions);
+    const DocumentOrdinal ordinal = static_cast<DocumentOrdinal>(document_table_.size());
+
+    vector<TermFreq> term_freqs;
+    for (const auto& [term, term_freq] : InternDocumentTerms(terms_, words)) {
+        term_to_postings_.Add(term, ordinal, term_freq);
+        term_freqs.push_back({ term, static_cast<float>(term_freq) });
+    }
+    forward_index_.Add(ordinal, term_freqs);
+    if (position_indexing_) {
+        vector<pair<TermId, uint32_t>> occurrences;
+        occurrences.reserve(words.size());
+        for (size_t i = 0; i < words.size(); ++i) {
+            occurrences.emplace_back(terms_.Find(words[i]), positions[i]);
+        }
+        position_index_.Add(ordinal, move(occurrences));
     }
 
     all_doc_id_.insert(document_id);
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+    document_table_.Add(document_id, ComputeAverageRating(ratings), status, static_cast<uint32_t>(words.size()));
+    documents_.emplace(document_id, ordinal);
+    ++generation_;
+}
+
+void SearchServer::AddDocuments(const vector<NewDocument>& documents) {
+    AddDocuments(execution::seq, documents);
 }
 
 void SearchServer::RemoveDocument(int document_id) {
     RemoveDocument(execution::seq, document_id);
 }
 
+void SearchServer::RemoveDocuments(const vector<int>& document_ids) {
+    RemoveDocuments(execution::seq, document_ids);
+}
+
 using It = std::set<int>::const_iterator;
-It SearchServer::begin() {
+It SearchServer::begin() const {
     return all_doc_id_.begin();
 }
-It SearchServer::end() {
+It SearchServer::end() const {
     return all_doc_id_.end();
 }
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    if (document_id_to_word_freqs_.count(document_id))
-        return document_id_to_word_freqs_.at(document_id);
-    else
-        return words_to_freq_empty_map_;
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return {};
+    }
+    return forward_index_.Get(it->second, terms_);
 }
 
 int SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const {
-    Query query = ParseQuery(policy, raw_query);
+uint64_t SearchServer::GetGeneration() const {
+    return generation_;
+}
 
-    const auto& word_to_freq = GetWordFrequencies(document_id);
-    vector<string_view> doc_words;
-    doc_words.reserve(word_to_freq.size());
-    for (const auto& [word, _] : word_to_freq) {
-        doc_words.push_back(word);
-    }
+string SearchServer::NormalizeQuery(string_view raw_query) const {
+    return ::NormalizeQuery(raw_query, stop_words_, GetQuerySyntax());
+}
 
-    vector<string_view> matched_words;
-    vector<string_view>& minus = query.minus_words;
+SearchPage SearchServer::FindTopDocumentsPage(string_view raw_query, size_t page_size, string_view cursor) const {
+    return FindTopDocumentsPage(execution::seq, raw_query, DocumentStatus::ACTUAL, page_size, cursor);
+}
 
-    for (const auto& word : minus) {
-        if (binary_search(doc_words.begin(), doc_words.end(), word)) {
-            return { matched_words, documents_.at(document_id).status };
-        }
-    }
+void SearchServer::SetMaxResultDocumentCount(size_t count) {
+    max_result_document_count_ = count;
+    ++generation_;
+}
+
+size_t SearchServer::GetMaxResultDocumentCount() const {
+    return max_result_document_count_;
+}
+
+IndexStats SearchServer::GetIndexStats() const {
+    IndexStats stats = term_to_postings_.GetStats();
+    stats.dictionary_memory_bytes = terms_.GetMemoryUsage();
+    stats.forward_index_memory_bytes = forward_index_.GetMemoryUsage();
+    stats.position_index_memory_bytes = position_index_.GetMemoryUsage();
+    return stats;
+}
+
+void SearchServer::SetQueryMode(QueryMode mode) {
+    query_mode_ = mode;
+}
+
+QueryMode SearchServer::GetQueryMode() const {
+    return query_mode_;
+}
 
+void SearchServer::SetMatchMode(MatchMode mode) {
+    match_mode_ = mode;
+    ++generation_;
+}
 
-    vector<string_view>& plus = query.plus_words;
-    matched_words.resize(min(doc_words.size(), plus.size()));
+MatchMode SearchServer::GetMatchMode() const {
+    return match_mode_;
+}
 
+void SearchServer::SetRankingFunction(RankingFunction function) {
+    ranking_function_ = function;
+    ++generation_;
+}
 
-    sort(policy, plus.begin(), plus.end());
-    plus.erase(unique(plus.begin(), plus.end()), plus.end());
-    auto it = set_intersection(policy, plus.begin(), plus.end(), doc_words.begin(), doc_words.end(), matched_words.begin());
-    matched_words.resize(it - matched_words.begin());
-    return { matched_words, documents_.at(document_id).status };
+RankingFunction SearchServer::GetRankingFunction() const {
+    return ranking_function_;
+}
+
+void SearchServer::SetPositionIndexing(bool enabled) {
+    if (!documents_.empty()) {
+        throw logic_error("position indexing can only change before documents are added");
+    }
+    position_indexing_ = enabled;
+    position_index_ = PositionIndex();
+}
 
+bool SearchServer::GetPositionIndexing() const {
+    return position_indexing_;
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const {
+    Query query = ParseQuery(policy, raw_query);
+    const vector<PositionClause> clauses = FindPositionClauses(query);
+    const DocumentOrdinal ordinal = documents_.at(document_id);
+    const DocumentStatus status = document_table_.Get(ordinal).status;
+    const WordFrequencies word_freqs = forward_index_.Get(ordinal, terms_);
+    auto in_document = [&](string_view word) {
+        const TermId term = terms_.Find(word);
+        return term != NO_TERM && word_freqs.ContainsTerm(term);
+    };
+
+    if (any_of(policy, query.minus_words.begin(), query.minus_words.end(), in_document)
+        || !MatchesPositionClauses(ordinal, clauses)) {
+        return { vector<string_view>{}, status };
+    }
+
+    vector<string_view> matched_words(query.plus_words.size());
+    auto it = copy_if(policy, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), in_document);
+    matched_words.erase(it, matched_words.end());
+    sort(policy, matched_words.begin(), matched_words.end());
+    matched_words.erase(unique(matched_words.begin(), matched_words.end()), matched_words.end());
+    return { matched_words, status };
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(execution::sequenced_policy policy, string_view raw_query, int document_id) const {
     const Query query = ParseQuery(policy, raw_query);
+    const vector<PositionClause> clauses = FindPositionClauses(query);
     vector<string_view> matched_words;
+    const DocumentOrdinal ordinal = documents_.at(document_id);
+    const DocumentStatus status = document_table_.Get(ordinal).status;
 
     for (string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { matched_words, documents_.at(document_id).status };
+        const PostingList* postings = FindPostings(word);
+        if (postings && postings->Contains(ordinal)) {
+            return { matched_words, status };
         }
     }
+    if (!MatchesPositionClauses(ordinal, clauses)) {
+        return { matched_words, status };
+    }
 
     for (string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
+        const PostingList* postings = FindPostings(word);
+        if (postings && postings->Contains(ordinal)) {
             matched_words.push_back(word);
         }
     }
 
     sort(matched_words.begin(), matched_words.end());
     matched_words.erase(unique(matched_words.begin(), matched_words.end()), matched_words.end());
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, status };
 }
 
 tuple<vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
     return SearchServer::MatchDocument(execution::seq, raw_query, document_id);
 }
 
+void SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids, DocumentMatches& matches) const {
+    const Query query = ParseQuery(raw_query);
+    // Words missing from the dictionary match nothing; plus terms keep the order of the sorted words
+    vector<TermId> minus_terms;
+    for (string_view word : query.minus_words) {
+        if (const TermId term = terms_.Find(word); term != NO_TERM) {
+            minus_terms.push_back(term);
+        }
+    }
+    vector<TermId> plus_terms;
+    for (string_view word : query.plus_words) {
+        if (const TermId term = terms_.Find(word); term != NO_TERM) {
+            plus_terms.push_back(term);
+        }
+    }
+    const vector<PositionClause> clauses = FindPositionClauses(query);
+
+    matches.Clear();
+    matches.statuses.reserve(document_ids.size());
+    matches.offsets.reserve(document_ids.size() + 1);
+    for (int document_id : document_ids) {
+        const DocumentOrdinal ordinal = documents_.at(document_id);
+        const WordFrequencies word_freqs = forward_index_.Get(ordinal, terms_);
+        if (none_of(minus_terms.begin(), minus_terms.end(), [&word_freqs](TermId term) { return word_freqs.ContainsTerm(term); })
+            && MatchesPositionClauses(ordinal, clauses)) {
+            for (TermId term : plus_terms) {
+                if (word_freqs.ContainsTerm(term)) {
+                    matches.words.push_back(terms_.GetTerm(term));
+                }
+            }
+        }
+        matches.statuses.push_back(document_table_.Get(ordinal).status);
+        matches.offsets.push_back(matches.words.size());
+    }
+}
+
+DocumentMatches SearchServer::MatchDocuments(string_view raw_query, const vector<int>& document_ids) const {
+    DocumentMatches matches;
+    MatchDocuments(raw_query, document_ids, matches);
+    return matches;
+}
+
+// Surviving terms keep their relative order, so forward entries stay sorted by TermId
+void SearchServer::CollectEmptyTerms() {
+    TermDictionary terms;
+    vector<TermId> new_terms(terms_.size(), NO_TERM);
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        if (term_to_postings_.Find(term)) {
+            new_terms[term] = terms.Intern(terms_.GetTerm(term));
+        }
+    }
+    term_to_postings_.RemapTerms(new_terms);
+    forward_index_.RemapTerms(new_terms);
+    position_index_.RemapTerms(new_terms);
+    terms_ = move(terms);
+}
+
+void SearchServer::CheckNewDocumentIds(const vector<NewDocument>& documents) const {
+    set<int> batch_ids;
+    for (const NewDocument& document : documents) {
+        if (documents_.count(document.id) != 0 || !batch_ids.insert(document.id).second) throw invalid_argument("document id already exists");
+        if (document.id < 0) throw invalid_argument("negative document id");
+    }
+}
+
+SearchServer::PartialIndex SearchServer::BuildPartialIndex(const vector<NewDocument>& documents, size_t first, size_t last) const {
+    PartialIndex partial_index;
+    partial_index.first = first;
+    partial_index.last = last;
+    partial_index.term_freq_offsets.push_back(0);
+    partial_index.occurrence_offsets.push_back(0);
+    vector<uint32_t> positions;
+    for (size_t i = first; i < last; ++i) {
+        const vector<string_view> words = SplitIntoWordsNoStop(documents[i].text, positions);
+        const vector<pair<TermId, double>> term_freqs = InternDocumentTerms(partial_index.terms, words);
+        partial_index.term_freqs.insert(partial_index.term_freqs.end(), term_freqs.begin(), term_freqs.end());
+        partial_index.term_freq_offsets.push_back(partial_index.term_freqs.size());
+        if (position_indexing_) {
+            for (size_t j = 0; j < words.size(); ++j) {
+                partial_index.occurrences.emplace_back(partial_index.terms.Find(words[j]), positions[j]);
+            }
+        }
+        partial_index.occurrence_offsets.push_back(partial_index.occurrences.size());
+        partial_index.ratings.push_back(ComputeAverageRating(documents[i].ratings));
+        partial_index.word_counts.push_back(static_cast<uint32_t>(words.size()));
+    }
+    return partial_index;
+}
+
+// Local terms are numbered by first appearance, so interning them in order per chunk
+// hands out the same TermIds as adding the documents one by one
+void SearchServer::MergePartialIndexes(const vector<NewDocument>& documents, const vector<PartialIndex>& partial_indexes) {
+    document_table_.Reserve(document_table_.size() + documents.size());
+    vector<TermId> global_terms;
+    vector<TermFreq> term_freqs;
+    vector<pair<TermId, uint32_t>> occurrences;
+    for (const PartialIndex& partial_index : partial_indexes) {
+        global_terms.clear();
+        for (string_view word : partial_index.terms.GetTerms()) {
+            global_terms.push_back(terms_.Intern(word));
+        }
+
+        for (size_t i = partial_index.first; i < partial_index.last; ++i) {
+            const NewDocument& document = documents[i];
+            const size_t local = i - partial_index.first;
+            const DocumentOrdinal ordinal = static_cast<DocumentOrdinal>(document_table_.size());
+
+            term_freqs.clear();
+            for (size_t j = partial_index.term_freq_offsets[local]; j < partial_index.term_freq_offsets[local + 1]; ++j) {
+                const auto [term, term_freq] = partial_index.term_freqs[j];
+                term_to_postings_.Add(global_terms[term], ordinal, term_freq);
+                term_freqs.push_back({ global_terms[term], static_cast<float>(term_freq) });
+            }
+            sort(term_freqs.begin(), term_freqs.end(), [](const TermFreq& lhs, const TermFreq& rhs) { return lhs.term < rhs.term; });
+            forward_index_.Add(ordinal, term_freqs);
+            if (position_indexing_) {
+                occurrences.clear();
+                for (size_t j = partial_index.occurrence_offsets[local]; j < partial_index.occurrence_offsets[local + 1]; ++j) {
+                    const auto [term, position] = partial_index.occurrences[j];
+                    occurrences.emplace_back(global_terms[term], position);
+                }
+                position_index_.Add(ordinal, occurrences);
+            }
+
+            all_doc_id_.insert(document.id);
+            document_table_.Add(document.id, partial_index.ratings[local], document.status, partial_index.word_counts[local]);
+            documents_.emplace(document.id, ordinal);
+        }
+    }
+    ++generation_;
+}
+
 bool SearchServer::IsStopWord(const string_view word) const {
     return stop_words_.count(word) > 0;
 }
 
 vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text) const {
-    vector<string_view> words;
-    for (string_view word : SplitIntoWords(text)) {
-        CheckWordSymbols(word);
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+    vector<string_view> words = SplitIntoValidWords(text);
+    words.erase(remove_if(words.begin(), words.end(), [this](string_view word) { return IsStopWord(word); }), words.end());
+    return words;
+}
+
+vector<string_view> SearchServer::SplitIntoWordsNoStop(string_view text, vector<uint32_t>& positions) const {
+    vector<string_view> words = SplitIntoValidWords(text);
+    positions.clear();
+    size_t kept = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        if (!IsStopWord(words[i])) {
+            words[kept++] = words[i];
+            positions.push_back(static_cast<uint32_t>(i));
         }
     }
+    words.resize(kept);
     return words;
 }
 
-int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
-    if (ratings.empty()) {
-        return 0;
-    }
-    int rating_sum = accumulate(ratings.begin(), ratings.end(), 0);
-    return rating_sum / static_cast<int>(ratings.size());
+
+Query SearchServer::ParseQuery(execution::sequenced_policy, string_view text) const {
+    return ::ParseQuery(text, stop_words_, true, GetQuerySyntax());
 }
 
+// Parallel matching deduplicates its own result, so the query words are left as they are
+Query SearchServer::ParseQuery(execution::parallel_policy, string_view text) const {
+    return ::ParseQuery(text, stop_words_, false, GetQuerySyntax());
+}
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
-    CheckWordSymbols(text);
-    CheckMinusWord(text);
-    bool is_minus = false;
-    // Word shouldn't be empty
-    if (text[0] == '-') {
-        is_minus = true;
-        text = text.substr(1);
-    }
-    return { text, is_minus, IsStopWord(text) };
+Query SearchServer::ParseQuery(string_view text) const {
+    return ParseQuery(execution::seq, text);
 }
 
+QuerySyntax SearchServer::GetQuerySyntax() const {
+    return position_indexing_ ? QuerySyntax::PROXIMITY : QuerySyntax::PLAIN;
+}
+
+const PostingList* SearchServer::FindPostings(string_view word) const {
+    const TermId term = terms_.Find(word);
+    return term == NO_TERM ? nullptr : term_to_postings_.Find(term);
+}
+
+optional<ScoredPostings> SearchServer::FindScoredPostings(string_view word) const {
+    const PostingList* postings = FindPostings(word);
+    if (!postings) {
+        return nullopt;
+    }
+    return ScoredPostings{ postings->GetSpan(), postings->GetInverseDocumentFreq(documents_.size()) };
+}
 
-SearchServer::Query SearchServer::ParseQuery(std::execution::sequenced_policy policy, string_view text) const {
-    Query query;
-    for (string_view word : SplitIntoWords(text)) {
-        QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.push_back(move(query_word.data));
+QueryPostings SearchServer::FindQueryPostings(const Query& query) const {
+    QueryPostings query_postings;
+    for (string_view word : query.plus_words) {
+        if (optional<ScoredPostings> postings = FindScoredPostings(word)) {
+            query_postings.plus.push_back(*postings);
+        }
+        else {
+            query_postings.has_missing_plus_word = true;
+        }
+    }
+    for (string_view word : query.minus_words) {
+        if (const PostingList* postings = FindPostings(word)) {
+            query_postings.minus.push_back(postings->GetSpan());
+        }
+    }
+    for (const ProximityClause& clause : query.proximity_clauses) {
+        for (string_view word : clause.words) {
+            if (const PostingList* postings = FindPostings(word)) {
+                query_postings.required.push_back(postings->GetSpan());
             }
             else {
-                query.plus_words.push_back(move(query_word.data));
+                query_postings.has_missing_required_word = true;
             }
         }
     }
-    sort(query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
-    return query;   
+    return query_postings;
 }
 
-SearchServer::Query SearchServer::ParseQuery(std::execution::parallel_policy policy, string_view text) const {
-    Query query;
-    for (string_view word : SplitIntoWords(text)) {
-        QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.push_back(move(query_word.data));
-            }
-            else {
-                query.plus_words.push_back(move(query_word.data));
-            }
+vector<PositionClause> SearchServer::FindPositionClauses(const Query& query) const {
+    vector<PositionClause> clauses;
+    clauses.reserve(query.proximity_clauses.size());
+    for (const ProximityClause& clause : query.proximity_clauses) {
+        PositionClause& position_clause = clauses.emplace_back();
+        for (string_view word : clause.words) {
+            position_clause.terms.push_back(terms_.Find(word));
         }
+        position_clause.offsets = clause.offsets;
+        position_clause.max_distance = clause.max_distance;
     }
-    return query;
+    return clauses;
+}
 
+// Words missing from the dictionary have no positions, so their clauses never match
+bool SearchServer::MatchesPositionClauses(DocumentOrdinal ordinal, const vector<PositionClause>& clauses) const {
+    return clauses.empty() || position_index_.Matches(ordinal, clauses);
+}
 
+DocumentInfo SearchServer::GetDocumentInfo(DocumentOrdinal ordinal) const {
+    return document_table_.Get(ordinal);
 }
 
-SearchServer::Query SearchServer::ParseQuery(string_view text) const {
-    return ParseQuery(execution::seq, text);
+uint64_t SearchServer::GetCursorQueryHash(string_view raw_query, DocumentStatus status) const {
+    return hash<string>{}(NormalizeQuery(raw_query)) ^ (static_cast<uint64_t>(status) + 1) * 0x9E3779B97F4A7C15ULL;
 }
 
-// Existence required
-double SearchServer::ComputeWordInverseDocumentFreq(string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+Bm25Scorer SearchServer::GetBm25Scorer() const {
+    Bm25Scorer scorer;
+    scorer.word_counts = document_table_.GetWordCounts();
+    scorer.average_word_count = document_table_.GetAverageWordCount();
+    return scorer;
 }
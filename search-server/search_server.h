@@ -6,15 +6,30 @@
 #include <cmath>
 #include <utility>
 #include <execution>
+#include <numeric>
+#include <type_traits>
+#include <optional>
+#include <exception>
+#include <stdexcept>
 #include "document.h"
+#include "document_table.h"
 #include "string_processing.h"
 #include "log_duration.h"
-#include "concurrent_map.h"
+#include "forward_index.h"
+#include "inverted_index.h"
+#include "position_index.h"
+#include "term_dictionary.h"
+#include "score_accumulator.h"
+#include "query.h"
+#include "query_engine.h"
+#include "scorer.h"
+#include "search_cursor.h"
 
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-const double EPSILON = 1e-6;
-const int CONCURRENT_MAP_PARTS_COUNT = 5000;
+// Documents tokenized by one AddDocuments task
+const size_t ADD_DOCUMENTS_CHUNK_SIZE = 1024;
+const size_t MAX_ADD_DOCUMENTS_CHUNKS = 64;
 
 class SearchServer {
 
@@ -25,14 +40,24 @@ public:
     explicit SearchServer(std::string_view stop_words_text);
 
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    // Same result as adding the documents one by one. Chunks are tokenized and interned in parallel,
+    // then merged into the index in a single pass. Throws invalid_argument like AddDocument, before anything is added.
+    template <typename ExecutionPolicy>
+    void AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents);
+    void AddDocuments(const std::vector<NewDocument>& documents);
 
     template <typename  ExecutionPolicy>
     void RemoveDocument(ExecutionPolicy&& policy, int document_id);
     void RemoveDocument(int document_id);
+    // Unknown ids are skipped. Postings are grouped by term and every term's list is rewritten once, by one task.
+    // Once terms without postings outnumber the rest, they are dropped from the dictionary and TermIds are renumbered.
+    template <typename  ExecutionPolicy>
+    void RemoveDocuments(ExecutionPolicy&& policy, const std::vector<int>& document_ids);
+    void RemoveDocuments(const std::vector<int>& document_ids);
 
     using It = std::set<int>::const_iterator;
-    It begin();
-    It end();
+    It begin() const;
+    It end() const;
 
     template <typename DocumentPredicate, typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
@@ -53,56 +78,125 @@ public:
         return FindTopDocuments(std::execution::seq, raw_query);
     }
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Walks all results of a query page by page, in the order of FindTopDocuments. Without a cursor returns the first
+    // page_size documents; pass a page's next_cursor to get the page after it, which is found by one pass in the
+    // query mode that keeps only documents ranked after the cursor. Throws invalid_argument for a malformed cursor or one
+    // issued for another query or status, or before the index changed.
+    template <typename ExecutionPolicy>
+    SearchPage FindTopDocumentsPage(ExecutionPolicy policy, std::string_view raw_query, DocumentStatus status,
+        size_t page_size, std::string_view cursor = {}) const;
+    SearchPage FindTopDocumentsPage(std::string_view raw_query, size_t page_size, std::string_view cursor = {}) const;
+
+    // Answers each query like FindTopDocuments(policy, query) in EXHAUSTIVE mode, sharing lookups and posting reads
+    // across the batch.
+    template <typename ExecutionPolicy>
+    QueryBatchResults FindTopDocumentsBatch(ExecutionPolicy policy, const std::vector<std::string>& raw_queries) const;
+
+    // Ordered by internal term id; invalidated by AddDocument and RemoveDocument
+    WordFrequencies GetWordFrequencies(int document_id) const;
 
     int GetDocumentCount() const;
+    // Changes whenever a query could get a different answer, so cached results can be checked against it
+    uint64_t GetGeneration() const;
+    // See ::NormalizeQuery
+    std::string NormalizeQuery(std::string_view raw_query) const;
+
+    // How many documents FindTopDocuments returns; raise it to paginate deeper than the default
+    void SetMaxResultDocumentCount(size_t count);
+    size_t GetMaxResultDocumentCount() const;
+
+    IndexStats GetIndexStats() const;
+
+    // Both modes return the same documents. PRUNED pays off for small result counts (up to about a hundred) and for
+    // queries mixing rare and frequent words; with large counts it does more work than EXHAUSTIVE.
+    void SetQueryMode(QueryMode mode);
+    QueryMode GetQueryMode() const;
+    // Whether FindTopDocuments wants any or all of the plus words; ANY by default
+    void SetMatchMode(MatchMode mode);
+    MatchMode GetMatchMode() const;
+    // TF_IDF by default. Each function has its own instantiation of the evaluation, chosen once per query.
+    void SetRankingFunction(RankingFunction function);
+    RankingFunction GetRankingFunction() const;
+    // Whether documents keep their word positions, which "quoted phrase" and NEAR/k queries need; off by default.
+    // Without them quotes and NEAR/k are parts of plain words, as they always were.
+    // Throws logic_error unless the server has no documents.
+    void SetPositionIndexing(bool enabled);
+    bool GetPositionIndexing() const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy policy, std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const;
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+    // MatchDocument for each of the documents, with the query parsed and its words looked up once.
+    // Documents are checked through their forward entries behind a bloom filter. The word views point
+    // into the dictionary and stay valid until the index changes. Throws out_of_range for unknown documents.
+    void MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids, DocumentMatches& matches) const;
+    DocumentMatches MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
 
+    // Writes the live documents, with the ranking function and the document lengths, in the format SnapshotSearcher maps;
+    // the other settings are not saved. Defined in snapshot.cpp
+    void SaveSnapshot(const std::string& path) const;
 
 private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
+    // Documents [first, last) of an AddDocuments batch, interned into a dictionary of their own
+    struct PartialIndex {
+        size_t first = 0;
+        size_t last = 0;
+        TermDictionary terms;
+        // Runs of consecutive documents, each sorted by local TermId
+        std::vector<std::pair<TermId, double>> term_freqs;
+        std::vector<size_t> term_freq_offsets;
+        std::vector<int> ratings;
+        std::vector<uint32_t> word_counts;
+        // Runs of (local TermId, position) pairs, one run per document; empty without position indexing
+        std::vector<std::pair<TermId, uint32_t>> occurrences;
+        std::vector<size_t> occurrence_offsets;
     };
 
-    std::set<std::string> storage;
-    std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_id_to_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    TermDictionary terms_;
+    StopWords stop_words_;
+    InvertedIndex term_to_postings_;
+    ForwardIndex forward_index_;
+    PositionIndex position_index_;
+    std::map<int, DocumentOrdinal> documents_;
+    // Removed documents keep their slot, ordinals are never reused
+    DocumentTable document_table_;
+    mutable ScoreAccumulatorPool accumulators_;
     std::set<int> all_doc_id_;
-    std::map<std::string_view, double> words_to_freq_empty_map_;
-
-    bool IsStopWord(std::string_view word) const;
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
-    static int ComputeAverageRating(const std::vector<int>& ratings);
+    size_t max_result_document_count_ = MAX_RESULT_DOCUMENT_COUNT;
+    QueryMode query_mode_ = QueryMode::EXHAUSTIVE;
+    MatchMode match_mode_ = MatchMode::ANY;
+    RankingFunction ranking_function_ = RankingFunction::TF_IDF;
+    bool position_indexing_ = false;
+    uint64_t generation_ = 0;
 
-    struct QueryWord {
-        std::string_view data;
-        bool is_minus;
-        bool is_stop;
-    };
+    void CollectEmptyTerms();
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    void CheckNewDocumentIds(const std::vector<NewDocument>& documents) const;
+    PartialIndex BuildPartialIndex(const std::vector<NewDocument>& documents, size_t first, size_t last) const;
+    void MergePartialIndexes(const std::vector<NewDocument>& documents, const std::vector<PartialIndex>& partial_indexes);
 
-    struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
-    };
+    bool IsStopWord(std::string_view word) const;
+    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // positions[i] is where words[i] stands in the text, stop words counted
+    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text, std::vector<uint32_t>& positions) const;
 
     Query ParseQuery(std::execution::sequenced_policy policy, std::string_view text) const;
     Query ParseQuery(std::execution::parallel_policy policy, std::string_view text) const;
     Query ParseQuery(std::string_view text) const;
-
-    // Existence required
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
-
-    template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy policy, const Query& query,
-        DocumentPredicate document_predicate) const;
+    // PROXIMITY only with position indexing
+    QuerySyntax GetQuerySyntax() const;
+
+    // Returns nullptr for words without postings
+    const PostingList* FindPostings(std::string_view word) const;
+    std::optional<ScoredPostings> FindScoredPostings(std::string_view word) const;
+    // One dictionary probe per word; words missing from the index are dropped
+    QueryPostings FindQueryPostings(const Query& query) const;
+    std::vector<PositionClause> FindPositionClauses(const Query& query) const;
+    bool MatchesPositionClauses(DocumentOrdinal ordinal, const std::vector<PositionClause>& clauses) const;
+    DocumentInfo GetDocumentInfo(DocumentOrdinal ordinal) const;
+    Bm25Scorer GetBm25Scorer() const;
+    // Same for queries that NormalizeQuery makes equal
+    uint64_t GetCursorQueryHash(std::string_view raw_query, DocumentStatus status) const;
 };
 
 /*********************************************************************************/
@@ -112,33 +206,73 @@ SearchServer::SearchServer(const StringContainer& stop_words) {
         stop_words_.insert(std::string(word));
 }
 
+template <typename ExecutionPolicy>
+void SearchServer::AddDocuments(ExecutionPolicy&& policy, const std::vector<NewDocument>& documents) {
+    CheckNewDocumentIds(documents);
+    const size_t chunk_count = std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>
+        ? 1 : std::clamp<size_t>(documents.size() / ADD_DOCUMENTS_CHUNK_SIZE, 1, MAX_ADD_DOCUMENTS_CHUNKS);
+
+    std::vector<PartialIndex> partial_indexes(chunk_count);
+    std::vector<std::exception_ptr> errors(chunk_count);
+    std::vector<size_t> chunk_indexes(chunk_count);
+    std::iota(chunk_indexes.begin(), chunk_indexes.end(), size_t{ 0 });
+    std::for_each(policy, chunk_indexes.begin(), chunk_indexes.end(), [&](size_t chunk) {
+        // An exception escaping a parallel algorithm would terminate the program
+        try {
+            partial_indexes[chunk] = BuildPartialIndex(documents,
+                chunk * documents.size() / chunk_count, (chunk + 1) * documents.size() / chunk_count);
+        }
+        catch (...) {
+            errors[chunk] = std::current_exception();
+        }
+        });
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    MergePartialIndexes(documents, partial_indexes);
+}
+
 template <typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
-    const Query query = ParseQuery(std::execution::seq, raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-    std::sort(policy, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                return lhs.rating > rhs.rating;
-            }
-            else {
-                return lhs.relevance > rhs.relevance;
-            }
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    AddQueryCount(QueryCounter::QUERIES, 1);
+    QueryPostings query_postings;
+    std::vector<PositionClause> clauses;
+    {
+        QueryStageTimer parse_timer(QueryStage::PARSE);
+        const Query query = ParseQuery(std::execution::seq, raw_query);
+        query_postings = FindQueryPostings(query);
+        clauses = FindPositionClauses(query);
+    }
+    auto get_document_info = [this](DocumentOrdinal ordinal) { return GetDocumentInfo(ordinal); };
+    auto evaluate = [&](const auto& scorer) {
+        if (!clauses.empty()) {
+            return FindTopDocumentsWithClauses(match_mode_, scorer, query_postings, max_result_document_count_, std::nullopt,
+                [this, &clauses](DocumentOrdinal ordinal) { return MatchesPositionClauses(ordinal, clauses); },
+                get_document_info, document_predicate);
+        }
+        return EvaluateQuery(policy, query_mode_, match_mode_, scorer, std::move(query_postings), document_table_.size(),
+            max_result_document_count_, accumulators_, get_document_info, document_predicate);
+    };
+    if (ranking_function_ == RankingFunction::BM25) {
+        return evaluate(GetBm25Scorer());
     }
-    return matched_documents;
+    return evaluate(TfIdfScorer{});
 }
 
 
 
 template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentStatus status) const {
+    // Candidates are checked against the bitmap of the status, without fetching their info
+    if (const std::optional<OrdinalBitmap> status_bitmap = document_table_.FindStatusBitmap(status)) {
+        return FindTopDocuments(policy, raw_query, *status_bitmap);
+    }
     return FindTopDocuments(
         policy,
         raw_query,
-        [status](int document_id, DocumentStatus document_status, int rating) {
+        [status](int, DocumentStatus document_status, int) {
             return document_status == status;
         });
 }
@@ -147,56 +281,105 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy policy, std
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-
-
-template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy policy, const SearchServer::Query& query,
-    DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> concurrent_document_to_relevance(CONCURRENT_MAP_PARTS_COUNT);
-
-    std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](std::string_view word) {
-        if (word_to_document_freqs_.count(word) != 0) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    concurrent_document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                }
-            }
+template <typename ExecutionPolicy>
+SearchPage SearchServer::FindTopDocumentsPage(ExecutionPolicy policy, std::string_view raw_query, DocumentStatus status,
+    size_t page_size, std::string_view cursor) const {
+    const uint64_t query_hash = GetCursorQueryHash(raw_query, status);
+    std::optional<Document> after;
+    if (!cursor.empty()) {
+        const SearchCursor previous = SearchCursor::Parse(cursor);
+        if (previous.generation != generation_ || previous.query_hash != query_hash) {
+            throw std::invalid_argument("search cursor of another query or index state");
         }
-        });
+        after = previous.last;
+    }
+    const std::optional<OrdinalBitmap> status_bitmap = document_table_.FindStatusBitmap(status);
+    if (!status_bitmap) {
+        return {};
+    }
 
-    std::map<int, double> document_to_relevance(concurrent_document_to_relevance.BuildOrdinaryMap());
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+    AddQueryCount(QueryCounter::QUERIES, 1);
+    QueryPostings query_postings;
+    std::vector<PositionClause> clauses;
+    {
+        QueryStageTimer parse_timer(QueryStage::PARSE);
+        const Query query = ParseQuery(std::execution::seq, raw_query);
+        query_postings = FindQueryPostings(query);
+        clauses = FindPositionClauses(query);
+    }
+    auto get_document_info = [this](DocumentOrdinal ordinal) { return GetDocumentInfo(ordinal); };
+    auto evaluate = [&](const auto& scorer) {
+        if (!clauses.empty()) {
+            return FindTopDocumentsWithClauses(match_mode_, scorer, query_postings, page_size, after,
+                [this, &clauses](DocumentOrdinal ordinal) { return MatchesPositionClauses(ordinal, clauses); },
+                get_document_info, *status_bitmap);
         }
+        return EvaluateQueryPage(policy, query_mode_, match_mode_, scorer, std::move(query_postings), document_table_.size(),
+            page_size, after, accumulators_, get_document_info, *status_bitmap);
+    };
+    SearchPage page;
+    page.documents = ranking_function_ == RankingFunction::BM25 ? evaluate(GetBm25Scorer()) : evaluate(TfIdfScorer{});
+    if (page_size > 0 && page.documents.size() == page_size) {
+        page.next_cursor = SearchCursor{ generation_, query_hash, page.documents.back() }.ToString();
     }
+    return page;
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+template <typename ExecutionPolicy>
+QueryBatchResults SearchServer::FindTopDocumentsBatch(ExecutionPolicy policy, const std::vector<std::string>& raw_queries) const {
+    if (match_mode_ == MatchMode::ALL) {
+        return FindTopDocumentsEach(policy, raw_queries, *this);
     }
-    return matched_documents;
+    const QueryBatch batch = [&] {
+        QueryStageTimer parse_timer(QueryStage::PARSE);
+        return ParseQueryBatch(raw_queries, stop_words_, GetQuerySyntax(), [this](std::string_view word) { return FindScoredPostings(word); });
+    }();
+    if (batch.has_proximity_clauses) {
+        return FindTopDocumentsEach(policy, raw_queries, *this);
+    }
+    AddQueryCount(QueryCounter::QUERIES, raw_queries.size());
+    auto evaluate = [&](const auto& scorer) {
+        return EvaluateQueryBatch(policy, scorer, batch, document_table_.size(), max_result_document_count_, accumulators_,
+            [this](DocumentOrdinal ordinal) { return GetDocumentInfo(ordinal); },
+            *document_table_.FindStatusBitmap(DocumentStatus::ACTUAL));
+    };
+    if (ranking_function_ == RankingFunction::BM25) {
+        return evaluate(GetBm25Scorer());
+    }
+    return evaluate(TfIdfScorer{});
 }
 
 
+
 template <typename  ExecutionPolicy>
 void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    const auto& word_to_freq = GetWordFrequencies(document_id);
-    std::vector<std::string_view> words(word_to_freq.size());
-
-    std::transform(policy, word_to_freq.begin(), word_to_freq.end(), words.begin(), [](std::pair<std::string_view, double> word_freq) { return word_freq.first; });
-
-    std::for_each(policy, words.begin(), words.end(), [&](std::string_view word) { word_to_document_freqs_[word].erase(document_id); });
+    RemoveDocuments(policy, std::vector<int>{ document_id });
+}
 
-    document_id_to_word_freqs_.erase(document_id);
-    all_doc_id_.erase(document_id);
-    documents_.erase(document_id);
+template <typename  ExecutionPolicy>
+void SearchServer::RemoveDocuments(ExecutionPolicy&& policy, const std::vector<int>& document_ids) {
+    std::vector<std::pair<TermId, DocumentOrdinal>> postings;
+    for (int document_id : document_ids) {
+        const auto document_it = documents_.find(document_id);
+        if (document_it == documents_.end()) {
+            continue;
+        }
+        const DocumentOrdinal ordinal = document_it->second;
+        const WordFrequencies word_freqs = forward_index_.Get(ordinal, terms_);
+        for (const TermFreq* entry = word_freqs.data(); entry != word_freqs.data() + word_freqs.size(); ++entry) {
+            postings.emplace_back(entry->term, ordinal);
+        }
+        forward_index_.Remove(ordinal);
+        position_index_.Remove(ordinal);
+        document_table_.Remove(ordinal);
+        all_doc_id_.erase(document_id);
+        documents_.erase(document_it);
+        ++generation_;
+    }
+    term_to_postings_.RemovePostings(policy, std::move(postings));
+    if (term_to_postings_.GetEmptyTermCount() > terms_.size() / 2) {
+        CollectEmptyTerms();
+    }
 }
 
 
@@ -0,0 +1,793 @@
+// Equivalence checks on generated corpora: every alternative way of answering a query must agree with
+// SearchServer::FindTopDocuments. Run by ctest; a failed check names the query that broke it.
+#include "search_server.h"
+#include "ordinal_set.h"
+#include "process_queries.h"
+#include "query_cache.h"
+#include "remove_duplicates.h"
+#include "request_stats.h"
+#include "segmented_search_server.h"
+#include "snapshot.h"
+#include "string_processing.h"
+#include "test_framework.h"
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+namespace {
+
+struct TestCorpus {
+    vector<string> dictionary;
+    vector<string> documents;
+    vector<DocumentStatus> statuses;
+    vector<vector<int>> ratings;
+};
+
+// A small dictionary skewed towards its first words, so postings of very different lengths meet in one query
+string GetRandomWord(mt19937& generator, const vector<string>& dictionary) {
+    uniform_int_distribution<size_t> index(0, dictionary.size() - 1);
+    return dictionary[min(index(generator), index(generator))];
+}
+
+TestCorpus GenerateTestCorpus(mt19937& generator, size_t document_count) {
+    TestCorpus corpus;
+    for (int i = 0; i < 60; ++i) {
+        corpus.dictionary.push_back("w" + to_string(i));
+    }
+    uniform_int_distribution<int> word_count(1, 20);
+    uniform_int_distribution<int> status(0, DOCUMENT_STATUS_COUNT - 1);
+    uniform_int_distribution<int> rating(-2, 4);
+    for (size_t i = 0; i < document_count; ++i) {
+        // Copies give exact relevance ties, which rating and id must break
+        if (i > 0 && i % 10 == 0) {
+            corpus.documents.push_back(corpus.documents[i / 2]);
+        }
+        else {
+            string text;
+            for (int j = word_count(generator); j > 0; --j) {
+                text += GetRandomWord(generator, corpus.dictionary) + ' ';
+            }
+            corpus.documents.push_back(move(text));
+        }
+        corpus.statuses.push_back(i % 3 == 0 ? static_cast<DocumentStatus>(status(generator)) : DocumentStatus::ACTUAL);
+        corpus.ratings.push_back({ rating(generator), rating(generator) });
+    }
+    return corpus;
+}
+
+vector<string> GenerateTestQueries(mt19937& generator, const TestCorpus& corpus, size_t query_count, int max_word_count) {
+    uniform_int_distribution<int> word_count(1, max_word_count);
+    bernoulli_distribution is_minus(0.15);
+    vector<string> queries;
+    for (size_t i = 0; i < query_count; ++i) {
+        string query;
+        for (int j = word_count(generator); j > 0; --j) {
+            if (is_minus(generator)) {
+                query += '-';
+            }
+            query += GetRandomWord(generator, corpus.dictionary) + ' ';
+        }
+        // Words that no document has
+        if (i % 7 == 0) {
+            query += "absent ";
+        }
+        queries.push_back(move(query));
+    }
+    return queries;
+}
+
+template <typename Server>
+void AddTestCorpus(Server& server, const TestCorpus& corpus) {
+    for (size_t i = 0; i < corpus.documents.size(); ++i) {
+        server.AddDocument(static_cast<int>(i), corpus.documents[i], corpus.statuses[i], corpus.ratings[i]);
+    }
+}
+
+// Every third document of the first half is removed, so ordinals and postings have holes
+template <typename Server>
+void RemoveTestDocuments(Server& server, const TestCorpus& corpus) {
+    for (size_t i = 0; i < corpus.documents.size() / 2; i += 3) {
+        server.RemoveDocument(static_cast<int>(i));
+    }
+}
+
+template <typename Documents>
+void AssertSameDocuments(const vector<Document>& expected, const Documents& actual, const string& hint) {
+    vector<int> expected_ids;
+    for (const Document& document : expected) {
+        expected_ids.push_back(document.id);
+    }
+    vector<int> actual_ids;
+    for (const Document& document : actual) {
+        actual_ids.push_back(document.id);
+    }
+    AssertEqual(actual_ids, expected_ids, hint);
+    auto it = actual.begin();
+    for (const Document& document : expected) {
+        Assert(abs(it->relevance - document.relevance) < 1e-9 && it->rating == document.rating, hint);
+        ++it;
+    }
+}
+
+bool IsEvenRating(int, DocumentStatus, int rating) {
+    return rating % 2 == 0;
+}
+
+// Byte at a time: words split on spaces only, control bytes 0-31 make the text invalid
+vector<string_view> SplitIntoWordsReference(string_view text) {
+    vector<string_view> words;
+    size_t word_begin = text.size();
+    for (size_t pos = 0; pos <= text.size(); ++pos) {
+        if (pos == text.size() || text[pos] == ' ') {
+            if (word_begin != text.size()) {
+                words.push_back(text.substr(word_begin, pos - word_begin));
+                word_begin = text.size();
+            }
+        }
+        else if (word_begin == text.size()) {
+            word_begin = pos;
+        }
+    }
+    return words;
+}
+
+bool HasControlSymbol(string_view text) {
+    return any_of(text.begin(), text.end(), [](char c) { return c >= 0 && c <= 31; });
+}
+
+void AssertTokenizerMatchesReference(const string& text) {
+    const string hint = "text of " + to_string(text.size()) + " bytes";
+    const vector<string_view> expected = SplitIntoWordsReference(text);
+    AssertEqual(SplitIntoWords(text), expected, hint);
+    bool is_valid = true;
+    try {
+        AssertEqual(SplitIntoValidWords(text), expected, hint);
+    }
+    catch (const invalid_argument&) {
+        is_valid = false;
+    }
+    AssertEqual(is_valid, !HasControlSymbol(text), hint);
+    is_valid = true;
+    try {
+        CheckWordSymbols(text);
+    }
+    catch (const invalid_argument&) {
+        is_valid = false;
+    }
+    AssertEqual(is_valid, !HasControlSymbol(text), hint);
+}
+
+// The block kernels (16 bytes with SSE2, 32 with SEARCH_SERVER_AVX2) against the byte-at-a-time split
+void TestTokenizerMatchesScalarReference() {
+    // A word of every length at every offset around the block edges
+    for (size_t offset = 0; offset < 70; ++offset) {
+        for (size_t length = 1; length < 70; ++length) {
+            AssertTokenizerMatchesReference(string(offset, ' ') + string(length, 'a') + string(offset % 5, ' '));
+            AssertTokenizerMatchesReference(string(offset, 'b') + ' ' + string(length, '\xd0'));
+        }
+        // A control byte at every position
+        for (const char control : { '\0', '\t', '\n', '\x1f' }) {
+            string text(70, 'c');
+            text[offset] = control;
+            AssertTokenizerMatchesReference(text);
+        }
+    }
+
+    mt19937 generator(7);
+    // Spaces, ASCII letters, bytes from 0x80 up and now and then a control byte
+    const string symbols = string("      abcz\x80\xbf\xd0\xff\x7f!-\"") + '\x01';
+    uniform_int_distribution<size_t> symbol(0, symbols.size() - 1);
+    uniform_int_distribution<size_t> length(0, 150);
+    for (int i = 0; i < 5000; ++i) {
+        string text;
+        for (size_t j = length(generator); j > 0; --j) {
+            text += symbols[symbol(generator)];
+        }
+        AssertTokenizerMatchesReference(text);
+    }
+}
+
+// Text of the words in a shuffled order, some of them twice, and a stop word in between
+string ShuffleWords(mt19937& generator, vector<string> words) {
+    words.push_back(words.front());
+    shuffle(words.begin(), words.end(), generator);
+    string text = "and";
+    for (const string& word : words) {
+        text += ' ' + word;
+    }
+    return text;
+}
+
+// The baseline's rule: a document is a duplicate if a smaller id has the same set of words. Near duplicates
+// also go if their word set is similar enough to that of a smaller id that is kept.
+vector<int> FindDuplicatesReference(const SearchServer& search_server, double min_similarity) {
+    vector<pair<int, set<string>>> kept;
+    set<set<string>> seen;
+    vector<int> duplicates;
+    for (const int document_id : search_server) {
+        set<string> words;
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) {
+            words.insert(string(word));
+        }
+        const bool is_similar = any_of(kept.begin(), kept.end(), [&](const pair<int, set<string>>& other) {
+            vector<string> common;
+            set_intersection(words.begin(), words.end(), other.second.begin(), other.second.end(), back_inserter(common));
+            return static_cast<double>(common.size()) / (words.size() + other.second.size() - common.size()) >= min_similarity;
+            });
+        if (!seen.insert(words).second || is_similar) {
+            duplicates.push_back(document_id);
+        }
+        else {
+            kept.emplace_back(document_id, move(words));
+        }
+    }
+    return duplicates;
+}
+
+void TestDuplicatesMatchBruteForce() {
+    mt19937 generator(8);
+    vector<string> dictionary;
+    for (int i = 0; i < 3000; ++i) {
+        dictionary.push_back("d" + to_string(i));
+    }
+    uniform_int_distribution<size_t> word_index(0, dictionary.size() - 1);
+    auto random_words = [&] {
+        vector<string> words;
+        for (int i = 0; i < 12; ++i) {
+            words.push_back(dictionary[word_index(generator)]);
+        }
+        return words;
+    };
+
+    SearchServer search_server("and in"s);
+    int document_id = 0;
+    auto add = [&](const string& text) {
+        search_server.AddDocument(document_id++, text, DocumentStatus::ACTUAL, { 1 });
+    };
+    // Left without words by the stop words, so the second is a duplicate of the first
+    add("and in");
+    add("in in and");
+    for (int i = 0; i < 150; ++i) {
+        const vector<string> words = random_words();
+        add(ShuffleWords(generator, words));
+        // Same words in another order and with repeats
+        add(ShuffleWords(generator, words));
+        // One word of twelve replaced, Jaccard 11/13; a second one replaced in that, 10/14 with the first.
+        // With a threshold of 0.8 the third is similar only to the second, which is itself a duplicate
+        vector<string> variant = words;
+        variant[0] = dictionary[word_index(generator)];
+        add(ShuffleWords(generator, variant));
+        variant[1] = dictionary[word_index(generator)];
+        add(ShuffleWords(generator, variant));
+    }
+    // Documents sharing most of their words crowd the same band buckets
+    const vector<string> common_words = random_words();
+    for (int i = 0; i < 300; ++i) {
+        vector<string> words = common_words;
+        words[0] = "unique" + to_string(i);
+        add(ShuffleWords(generator, words));
+    }
+    for (int id = 10; id < document_id; id += 37) {
+        search_server.RemoveDocument(id);
+    }
+
+    const vector<int> expected = FindDuplicatesReference(search_server, 2.0);
+    AssertEqual(FindDuplicates(search_server), expected, "duplicates seq");
+    AssertEqual(FindDuplicates(execution::par, search_server), expected, "duplicates par");
+    AssertEqual(FindNearDuplicates(execution::par, search_server, 0.8), FindDuplicatesReference(search_server, 0.8), "near duplicates");
+
+    const int document_count = search_server.GetDocumentCount();
+    AssertEqual(RemoveDuplicates(search_server), expected, "removed duplicates");
+    ASSERT_EQUAL(search_server.GetDocumentCount(), document_count - static_cast<int>(expected.size()));
+    ASSERT(FindDuplicates(search_server).empty());
+}
+
+void TestQueryCacheKeysAndInvalidation() {
+    SearchServer search_server("in"s);
+    search_server.AddDocument(1, "a b in c", DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "a b b", DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "b d", DocumentStatus::ACTUAL, { 3 });
+    search_server.AddDocument(4, "a a d", DocumentStatus::BANNED, { 4 });
+    QueryCache cache(64);
+    uint64_t expected_hits = 0;
+    uint64_t expected_misses = 0;
+    uint64_t expected_stale = 0;
+    auto assert_stats = [&](const string& hint) {
+        const QueryCacheStats stats = cache.GetStats();
+        AssertEqual(stats.hit_count, expected_hits, hint + ": hits");
+        AssertEqual(stats.miss_count, expected_misses, hint + ": misses");
+        AssertEqual(stats.stale_count, expected_stale, hint + ": stale");
+    };
+    auto find = [&](const string& query) {
+        const vector<Document> documents = FindTopDocumentsCached(search_server, cache, query);
+        AssertSameDocuments(search_server.FindTopDocuments(query), documents, "cached: " + query);
+    };
+
+    // Word order, repeats and stop words do not change the key
+    find("b a -c a");
+    ++expected_misses;
+    find("a b -c");
+    find("in -c b a");
+    expected_hits += 2;
+    assert_stats("normalized key");
+    FindTopDocumentsCached(search_server, cache, "a b -c", DocumentStatus::BANNED);
+    ++expected_misses;
+    assert_stats("status");
+    ASSERT_EQUAL(cache.GetStats().size, 2u);
+
+    // Each change to the index or to the settings behind an answer turns the next lookup into a stale miss
+    const vector<pair<string, function<void()>>> changes = {
+        { "AddDocument", [&] { search_server.AddDocument(5, "a b", DocumentStatus::ACTUAL, { 5 }); } },
+        { "RemoveDocument", [&] { search_server.RemoveDocument(2); } },
+        { "SetMaxResultDocumentCount", [&] { search_server.SetMaxResultDocumentCount(1); } },
+        { "SetMatchMode", [&] { search_server.SetMatchMode(MatchMode::ALL); } },
+        { "SetRankingFunction", [&] { search_server.SetRankingFunction(RankingFunction::BM25); } },
+    };
+    for (const auto& [name, change] : changes) {
+        change();
+        find("b a -c");
+        ++expected_misses;
+        ++expected_stale;
+        assert_stats(name);
+        find("a b -c");
+        ++expected_hits;
+        assert_stats(name + " again");
+    }
+}
+
+// Threads record into their own stripes of a fixed clock; the rate counts only the elapsed part of the current second
+void TestRequestStatsWindow() {
+    using namespace std::chrono;
+    const RequestStats::Clock::time_point start{};
+    RequestStats stats(seconds(10), start);
+    auto assert_rate = [&](RequestWindowStats window, double expected, const string& hint) {
+        Assert(abs(window.requests_per_second - expected) < 1e-9, hint + ": rate " + to_string(window.requests_per_second));
+    };
+
+    const int thread_count = 8;
+    const int requests_per_thread = 1000;
+    vector<thread> threads;
+    for (int i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&stats, start, i] {
+            for (int request = 0; request < requests_per_thread; ++request) {
+                const auto finish = start + milliseconds(500 + 1000 * (request % 2));
+                stats.Record(finish, request % 10 == 0 ? 0 : 5, microseconds(i == 0 && request == 0 ? 5000 : 10));
+            }
+        });
+    }
+    for (thread& thread : threads) {
+        thread.join();
+    }
+
+    const uint64_t total = thread_count * requests_per_thread;
+    RequestWindowStats window = stats.GetStats(start + seconds(2));
+    ASSERT_EQUAL(window.request_count, total);
+    ASSERT_EQUAL(window.no_result_count, total / 10);
+    assert_rate(window, total / 2.0, "start of the third second");
+    assert_rate(stats.GetStats(start + milliseconds(2500)), total / 2.5, "middle of the third second");
+    Assert(window.p50_nanoseconds >= 10000 && window.p50_nanoseconds <= 10300, "p50 " + to_string(window.p50_nanoseconds));
+    Assert(window.p999_nanoseconds <= 10300, "p999 " + to_string(window.p999_nanoseconds));
+    Assert(window.max_nanoseconds >= 5000000 && window.max_nanoseconds <= 5150000, "max " + to_string(window.max_nanoseconds));
+
+    // Ten seconds on, the first second has left the window; the second one leaves it a second later
+    window = stats.GetStats(start + milliseconds(10500));
+    ASSERT_EQUAL(window.request_count, total / 2);
+    assert_rate(window, total / 2 / 9.5, "first second gone");
+    stats.Record(start + milliseconds(11200), 1, microseconds(20));
+    window = stats.GetStats(start + milliseconds(11250));
+    ASSERT_EQUAL(window.request_count, 1u);
+    ASSERT_EQUAL(window.no_result_count, 0u);
+    assert_rate(window, 1 / 9.25, "second second gone");
+    Assert(window.max_nanoseconds >= 20000 && window.max_nanoseconds <= 20600, "max " + to_string(window.max_nanoseconds));
+}
+
+vector<DocumentOrdinal> GetMembers(const OrdinalSet& set) {
+    vector<DocumentOrdinal> members;
+    set.ForEach([&members](DocumentOrdinal ordinal) { members.push_back(ordinal); });
+    return members;
+}
+
+void AssertSameOrdinals(const OrdinalSet& set, const std::set<DocumentOrdinal>& expected, const string& hint) {
+    AssertEqual(GetMembers(set), vector<DocumentOrdinal>(expected.begin(), expected.end()), hint);
+    AssertEqual(set.size(), expected.size(), hint + ": size");
+    ASSERT_EQUAL(set.empty(), expected.empty());
+}
+
+// Random adds and removes drive each group of 65536 ordinals back and forth across the array/bitmap switch
+// at 4096 members and the switch back at 2048, and the set algebra is checked on whatever forms the groups are in
+void TestOrdinalSetMatchesStdSet() {
+    mt19937 generator(9);
+    // Three groups, the first two adjacent; members crowd both ends of a group, next to its neighbours
+    const DocumentOrdinal group_keys[] = { 0, 1, 3 };
+    uniform_int_distribution<size_t> group(0, 2);
+    uniform_int_distribution<DocumentOrdinal> low(0, 16000 - 1);
+    auto random_ordinal = [&] {
+        const DocumentOrdinal value = low(generator);
+        return (group_keys[group(generator)] << 16) | (value < 8000 ? value : 65536 - 16000 + value);
+    };
+    bernoulli_distribution is_likely(0.7);
+
+    OrdinalSet lhs;
+    OrdinalSet rhs;
+    std::set<DocumentOrdinal> lhs_expected;
+    std::set<DocumentOrdinal> rhs_expected;
+    // Member counts to head for, about three groups' worth; the two sets are out of step
+    const size_t lhs_targets[] = { 14000, 9000, 12288, 4000, 12300, 300 };
+    const size_t rhs_targets[] = { 4000, 14000, 6000, 12288, 300, 12300 };
+    auto step = [&](OrdinalSet& set, std::set<DocumentOrdinal>& expected, size_t target, int i) {
+        const DocumentOrdinal ordinal = random_ordinal();
+        if ((expected.size() < target) == is_likely(generator)) {
+            set.Add(ordinal);
+            expected.insert(ordinal);
+        }
+        else {
+            // Mostly a member, the next one from a random point; now and then one that is not there
+            auto it = expected.lower_bound(ordinal);
+            const DocumentOrdinal removed = it == expected.end() || i % 10 == 0 ? ordinal : *it;
+            set.Remove(removed);
+            expected.erase(removed);
+        }
+    };
+    auto check = [&](const string& hint) {
+        AssertSameOrdinals(lhs, lhs_expected, hint + " lhs");
+        AssertSameOrdinals(rhs, rhs_expected, hint + " rhs");
+        for (int i = 0; i < 64; ++i) {
+            const DocumentOrdinal ordinal = random_ordinal();
+            ASSERT_EQUAL(lhs.Contains(ordinal), lhs_expected.count(ordinal) > 0);
+        }
+        std::set<DocumentOrdinal> expected;
+        set_intersection(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(), rhs_expected.end(), inserter(expected, expected.end()));
+        AssertSameOrdinals(lhs.And(rhs), expected, hint + " and");
+        expected.clear();
+        set_union(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(), rhs_expected.end(), inserter(expected, expected.end()));
+        AssertSameOrdinals(lhs.Or(rhs), expected, hint + " or");
+        expected.clear();
+        set_difference(lhs_expected.begin(), lhs_expected.end(), rhs_expected.begin(), rhs_expected.end(), inserter(expected, expected.end()));
+        AssertSameOrdinals(lhs.AndNot(rhs), expected, hint + " and not");
+        expected.clear();
+        set_difference(rhs_expected.begin(), rhs_expected.end(), lhs_expected.begin(), lhs_expected.end(), inserter(expected, expected.end()));
+        AssertSameOrdinals(rhs.AndNot(lhs), expected, hint + " and not reversed");
+        const vector<DocumentOrdinal> members(lhs_expected.begin(), lhs_expected.end());
+        AssertSameOrdinals(OrdinalSet::FromSorted(members.data(), members.data() + members.size()), lhs_expected, hint + " from sorted");
+    };
+
+    for (size_t phase = 0; phase < size(lhs_targets); ++phase) {
+        for (int i = 1; i <= 40000; ++i) {
+            step(lhs, lhs_expected, lhs_targets[phase], i);
+            step(rhs, rhs_expected, rhs_targets[phase], i);
+            if (i % 2500 == 0) {
+                check("phase " + to_string(phase) + " step " + to_string(i));
+            }
+        }
+    }
+}
+
+// Long queries too, where every term has a similar bound and little can be pruned
+void TestPrunedMatchesExhaustive() {
+    mt19937 generator(5);
+    // Enough ordinals for parallel queries to split them into several ranges
+    const TestCorpus corpus = GenerateTestCorpus(generator, PARALLEL_QUERY_CHUNK_SIZE * 3);
+    SearchServer search_server(corpus.dictionary[1]);
+    AddTestCorpus(search_server, corpus);
+    RemoveTestDocuments(search_server, corpus);
+    vector<string> queries = GenerateTestQueries(generator, corpus, 100, 6);
+    const vector<string> long_queries = GenerateTestQueries(generator, corpus, 30, 40);
+    queries.insert(queries.end(), long_queries.begin(), long_queries.end());
+
+    for (const RankingFunction ranking_function : { RankingFunction::TF_IDF, RankingFunction::BM25 }) {
+        search_server.SetRankingFunction(ranking_function);
+        for (const size_t count : { 1, 5, 50 }) {
+            search_server.SetMaxResultDocumentCount(count);
+            for (const string& query : queries) {
+                search_server.SetQueryMode(QueryMode::EXHAUSTIVE);
+                const vector<Document> expected = search_server.FindTopDocuments(query);
+                const vector<Document> expected_banned = search_server.FindTopDocuments(query, DocumentStatus::BANNED);
+                const vector<Document> expected_even = search_server.FindTopDocuments(query, IsEvenRating);
+                search_server.SetQueryMode(QueryMode::PRUNED);
+                AssertSameDocuments(expected, search_server.FindTopDocuments(query), "pruned seq: " + query);
+                AssertSameDocuments(expected, search_server.FindTopDocuments(execution::par, query), "pruned par: " + query);
+                AssertSameDocuments(expected_banned, search_server.FindTopDocuments(query, DocumentStatus::BANNED),
+                    "pruned banned: " + query);
+                AssertSameDocuments(expected_even, search_server.FindTopDocuments(execution::par, query, IsEvenRating),
+                    "pruned predicate: " + query);
+            }
+        }
+    }
+}
+
+void TestBatchMatchesSingleQueries() {
+    mt19937 generator(1);
+    const TestCorpus corpus = GenerateTestCorpus(generator, 3000);
+    // The stop word is a frequent one, so it drops words from documents and queries alike
+    SearchServer search_server(corpus.dictionary[1]);
+    AddTestCorpus(search_server, corpus);
+    RemoveTestDocuments(search_server, corpus);
+    const vector<string> queries = GenerateTestQueries(generator, corpus, 300, 8);
+    for (const size_t count : { 5, 40 }) {
+        search_server.SetMaxResultDocumentCount(count);
+        const QueryBatchResults seq_results = search_server.FindTopDocumentsBatch(execution::seq, queries);
+        const QueryBatchResults par_results = ProcessQueriesBatch(search_server, queries);
+        ASSERT_EQUAL(seq_results.size(), queries.size());
+        ASSERT_EQUAL(par_results.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const vector<Document> expected = search_server.FindTopDocuments(queries[i]);
+            AssertSameDocuments(expected, seq_results[i], "batch seq: " + queries[i]);
+            AssertSameDocuments(expected, par_results[i], "batch par: " + queries[i]);
+        }
+    }
+}
+
+void TestSnapshotMatchesServer() {
+    mt19937 generator(2);
+    const TestCorpus corpus = GenerateTestCorpus(generator, 2000);
+    SearchServer search_server(corpus.dictionary[1]);
+    AddTestCorpus(search_server, corpus);
+    RemoveTestDocuments(search_server, corpus);
+    const vector<string> queries = GenerateTestQueries(generator, corpus, 200, 6);
+
+    const string path = (filesystem::temp_directory_path() / "search_server_tests.snapshot").string();
+    // The ranking function is saved; the other settings are the searcher's own and are set alike below
+    for (const RankingFunction ranking_function : { RankingFunction::TF_IDF, RankingFunction::BM25 }) {
+        search_server.SetRankingFunction(ranking_function);
+        search_server.SetMatchMode(MatchMode::ANY);
+        search_server.SaveSnapshot(path);
+        SnapshotSearcher snapshot(path);
+        ASSERT_EQUAL(snapshot.GetDocumentCount(), search_server.GetDocumentCount());
+        ASSERT(snapshot.GetRankingFunction() == ranking_function);
+        for (const MatchMode match_mode : { MatchMode::ANY, MatchMode::ALL }) {
+            search_server.SetMatchMode(match_mode);
+            snapshot.SetMatchMode(match_mode);
+            for (const QueryMode query_mode : { QueryMode::EXHAUSTIVE, QueryMode::PRUNED }) {
+                search_server.SetQueryMode(query_mode);
+                snapshot.SetQueryMode(query_mode);
+                for (const string& query : queries) {
+                    AssertSameDocuments(search_server.FindTopDocuments(query), snapshot.FindTopDocuments(query), "snapshot: " + query);
+                    AssertSameDocuments(search_server.FindTopDocuments(query, DocumentStatus::BANNED),
+                        snapshot.FindTopDocuments(query, DocumentStatus::BANNED), "snapshot banned: " + query);
+                    AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, IsEvenRating),
+                        snapshot.FindTopDocuments(execution::par, query, IsEvenRating), "snapshot predicate: " + query);
+                }
+            }
+        }
+        search_server.SetMatchMode(MatchMode::ANY);
+        snapshot.SetMatchMode(MatchMode::ANY);
+        const QueryBatchResults expected = search_server.FindTopDocumentsBatch(execution::seq, queries);
+        const QueryBatchResults actual = snapshot.FindTopDocumentsBatch(execution::par, queries);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            AssertSameDocuments(vector<Document>(expected[i].begin(), expected[i].end()), actual[i], "snapshot batch: " + queries[i]);
+        }
+        for (const int document_id : search_server) {
+            const string& query = queries[document_id % queries.size()];
+            ASSERT(search_server.MatchDocument(query, document_id) == snapshot.MatchDocument(query, document_id));
+        }
+    }
+    filesystem::remove(path);
+}
+
+void TestSegmentedMatchesServer() {
+    mt19937 generator(3);
+    // Enough documents for several sealed segments and merges
+    const TestCorpus corpus = GenerateTestCorpus(generator, SEGMENT_SEAL_DOCUMENT_COUNT * 3 + 100);
+    SearchServer search_server(corpus.dictionary[1]);
+    SegmentedSearchServer segmented_server(corpus.dictionary[1]);
+    AddTestCorpus(search_server, corpus);
+    AddTestCorpus(segmented_server, corpus);
+    RemoveTestDocuments(search_server, corpus);
+    RemoveTestDocuments(segmented_server, corpus);
+    segmented_server.WaitForMerges();
+    ASSERT_EQUAL(segmented_server.GetDocumentCount(), search_server.GetDocumentCount());
+
+    const vector<string> queries = GenerateTestQueries(generator, corpus, 200, 6);
+    // The pruned walk meets the tombstones of the segments as documents with REMOVED_DOCUMENT_ID
+    for (const QueryMode query_mode : { QueryMode::EXHAUSTIVE, QueryMode::PRUNED }) {
+        search_server.SetQueryMode(query_mode);
+        segmented_server.SetQueryMode(query_mode);
+        for (const MatchMode match_mode : { MatchMode::ANY, MatchMode::ALL }) {
+            search_server.SetMatchMode(match_mode);
+            segmented_server.SetMatchMode(match_mode);
+            for (const string& query : queries) {
+                AssertSameDocuments(search_server.FindTopDocuments(query), segmented_server.FindTopDocuments(query), "segmented: " + query);
+                AssertSameDocuments(search_server.FindTopDocuments(execution::par, query, DocumentStatus::IRRELEVANT),
+                    segmented_server.FindTopDocuments(execution::par, query, DocumentStatus::IRRELEVANT), "segmented irrelevant: " + query);
+            }
+        }
+    }
+    for (const int document_id : search_server) {
+        const string& query = queries[document_id % queries.size()];
+        ASSERT(search_server.MatchDocument(query, document_id) == segmented_server.MatchDocument(query, document_id));
+    }
+}
+
+void TestPagesConcatenateToFullOrder() {
+    mt19937 generator(4);
+    const TestCorpus corpus = GenerateTestCorpus(generator, 2000);
+    SearchServer search_server(corpus.dictionary[1]);
+    AddTestCorpus(search_server, corpus);
+    RemoveTestDocuments(search_server, corpus);
+    const vector<string> queries = GenerateTestQueries(generator, corpus, 60, 5);
+    for (const QueryMode query_mode : { QueryMode::EXHAUSTIVE, QueryMode::PRUNED }) {
+        search_server.SetQueryMode(query_mode);
+        for (const string& query : queries) {
+            search_server.SetMaxResultDocumentCount(corpus.documents.size());
+            const vector<Document> expected = search_server.FindTopDocuments(query);
+            search_server.SetMaxResultDocumentCount(MAX_RESULT_DOCUMENT_COUNT);
+
+            vector<Document> paged;
+            SearchPage page = search_server.FindTopDocumentsPage(query, 7);
+            paged.insert(paged.end(), page.documents.begin(), page.documents.end());
+            while (!page.next_cursor.empty()) {
+                page = search_server.FindTopDocumentsPage(query, 7, page.next_cursor);
+                paged.insert(paged.end(), page.documents.begin(), page.documents.end());
+            }
+            AssertSameDocuments(expected, paged, "pages: " + query);
+        }
+    }
+}
+
+// Words of a text with the positions they stand at, stop words counted
+vector<string> SplitTestWords(const string& text) {
+    vector<string> words;
+    for (size_t begin = 0; begin < text.size();) {
+        const size_t end = min(text.find(' ', begin), text.size());
+        if (end > begin) {
+            words.push_back(text.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    return words;
+}
+
+// Every word of the phrase at its offset from the first, stop words keeping their place
+bool HasPhrase(const vector<string>& words, vector<string> phrase, const string& stop_word) {
+    // Only the places between the words of a phrase count
+    while (!phrase.empty() && phrase.back() == stop_word) {
+        phrase.pop_back();
+    }
+    phrase.erase(phrase.begin(), find_if(phrase.begin(), phrase.end(), [&stop_word](const string& word) { return word != stop_word; }));
+    for (size_t first = 0; first + phrase.size() <= words.size(); ++first) {
+        bool matches = true;
+        for (size_t i = 0; i < phrase.size() && matches; ++i) {
+            matches = phrase[i] == stop_word || words[first + i] == phrase[i];
+        }
+        if (matches) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HasNear(const vector<string>& words, const string& left, const string& right, size_t distance) {
+    for (size_t i = 0; i < words.size(); ++i) {
+        for (size_t j = 0; j < words.size(); ++j) {
+            if (i != j && words[i] == left && words[j] == right && max(i, j) - min(i, j) <= distance) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TestPhraseQueriesMatchBruteForce() {
+    mt19937 generator(6);
+    const TestCorpus corpus = GenerateTestCorpus(generator, 2000);
+    const string& stop_word = corpus.dictionary[1];
+    SearchServer search_server(stop_word);
+    search_server.SetPositionIndexing(true);
+    AddTestCorpus(search_server, corpus);
+    RemoveTestDocuments(search_server, corpus);
+    search_server.SetMaxResultDocumentCount(corpus.documents.size());
+
+    uniform_int_distribution<size_t> document_index(0, corpus.documents.size() - 1);
+    uniform_int_distribution<int> phrase_length(2, 4);
+    uniform_int_distribution<size_t> near_distance(1, 3);
+    for (int i = 0; i < 200; ++i) {
+        // Phrases are cut from the documents, so most of them match something
+        const vector<string> source = SplitTestWords(corpus.documents[document_index(generator)]);
+        const size_t length = min<size_t>(phrase_length(generator), source.size());
+        const size_t first = uniform_int_distribution<size_t>(0, source.size() - length)(generator);
+        const vector<string> phrase(source.begin() + first, source.begin() + first + length);
+        const string& left = GetRandomWord(generator, corpus.dictionary);
+        const string& right = GetRandomWord(generator, corpus.dictionary);
+        const size_t distance = near_distance(generator);
+
+        string phrase_query;
+        string plain_query;
+        for (const string& word : phrase) {
+            phrase_query += (phrase_query.empty() ? "\"" : " ") + word;
+            plain_query += word + ' ';
+        }
+        phrase_query += '"';
+        const string near_query = left + " NEAR/" + to_string(distance) + ' ' + right;
+
+        // A clause query ranks its documents like the plain query of its words does
+        const vector<Document> plain_documents = search_server.FindTopDocuments(plain_query);
+        const vector<Document> near_plain_documents = search_server.FindTopDocuments(left + ' ' + right);
+        vector<Document> expected_phrase;
+        for (const Document& document : plain_documents) {
+            if (HasPhrase(SplitTestWords(corpus.documents[document.id]), phrase, stop_word)) {
+                expected_phrase.push_back(document);
+            }
+        }
+        // A NEAR/k next to a stop word is dropped with it
+        vector<Document> expected_near;
+        for (const Document& document : near_plain_documents) {
+            if (left == stop_word || right == stop_word || HasNear(SplitTestWords(corpus.documents[document.id]), left, right, distance)) {
+                expected_near.push_back(document);
+            }
+        }
+        AssertSameDocuments(expected_phrase, search_server.FindTopDocuments(phrase_query), "phrase: " + phrase_query);
+        AssertSameDocuments(expected_phrase, search_server.FindTopDocuments(execution::par, phrase_query), "phrase par: " + phrase_query);
+        AssertSameDocuments(expected_near, search_server.FindTopDocuments(near_query), "near: " + near_query);
+    }
+}
+
+// Without word positions quotes and NEAR/k are parts of plain words, as they were before positions existed
+void TestPlainSyntaxWithoutPositions() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "\"cat dog\" NEAR/2 NEAR/x cat\"", DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat and dog", DocumentStatus::ACTUAL, { 2 });
+    const vector<int> first_only = { 1 };
+    auto find_ids = [&search_server](const string& query) {
+        vector<int> ids;
+        for (const Document& document : search_server.FindTopDocuments(query)) {
+            ids.push_back(document.id);
+        }
+        return ids;
+    };
+    ASSERT_EQUAL(find_ids("\"cat"), first_only);
+    ASSERT_EQUAL(find_ids("NEAR/x"), first_only);
+    ASSERT_EQUAL(find_ids("cat\""), first_only);
+    ASSERT(find_ids("\"quoted\"").empty());
+    ASSERT_EQUAL(find_ids("cat NEAR/2 dog").size(), 2u);
+    ASSERT_EQUAL(search_server.FindTopDocuments(execution::seq, "-NEAR/2 cat"s).size(), 1u);
+    ASSERT_EQUAL(search_server.FindTopDocumentsBatch(execution::seq, { "\"cat"s, "cat NEAR/2 dog"s })[0].size(), 1u);
+    ASSERT(get<0>(search_server.MatchDocument("\"cat dog\"", 1)) == vector<string_view>({ "\"cat"sv, "dog\""sv }));
+
+    // A snapshot parses queries as the server that saved it did
+    const string path = (filesystem::temp_directory_path() / "search_server_tests_plain.snapshot").string();
+    search_server.SaveSnapshot(path);
+    {
+        const SnapshotSearcher snapshot(path);
+        ASSERT_EQUAL(snapshot.FindTopDocuments("\"cat"s).size(), 1u);
+        ASSERT_EQUAL(snapshot.FindTopDocuments("cat NEAR/2 dog"s).size(), 2u);
+    }
+    filesystem::remove(path);
+
+    SearchServer positional_server("and"s);
+    positional_server.SetPositionIndexing(true);
+    positional_server.AddDocument(1, "cat and dog", DocumentStatus::ACTUAL, { 1 });
+    try {
+        positional_server.FindTopDocuments("cat NEAR/x");
+        Assert(false, "NEAR/x must throw with positions");
+    }
+    catch (const invalid_argument&) {
+    }
+}
+
+}  // namespace
+
+int main() {
+    TestRunner tr;
+    RUN_TEST(tr, TestTokenizerMatchesScalarReference);
+    RUN_TEST(tr, TestOrdinalSetMatchesStdSet);
+    RUN_TEST(tr, TestPrunedMatchesExhaustive);
+    RUN_TEST(tr, TestBatchMatchesSingleQueries);
+    RUN_TEST(tr, TestSnapshotMatchesServer);
+    RUN_TEST(tr, TestSegmentedMatchesServer);
+    RUN_TEST(tr, TestPagesConcatenateToFullOrder);
+    RUN_TEST(tr, TestPhraseQueriesMatchBruteForce);
+    RUN_TEST(tr, TestPlainSyntaxWithoutPositions);
+    RUN_TEST(tr, TestDuplicatesMatchBruteForce);
+    RUN_TEST(tr, TestQueryCacheKeysAndInvalidation);
+    RUN_TEST(tr, TestRequestStatsWindow);
+}
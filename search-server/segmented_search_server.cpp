@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include "segmented_search_server.h"
+
+using namespace std;
+
+SegmentedSearchServer::SegmentedSearchServer(const string& stop_words_text)
+    : SegmentedSearchServer(string_view(stop_words_text)) {}
+
+SegmentedSearchServer::SegmentedSearchServer(string_view stop_words_text) {
+    for (string_view word : SplitIntoValidWords(stop_words_text)) {
+        stop_words_.emplace(word);
+    }
+    StartMerging();
+}
+
+SegmentedSearchServer::~SegmentedSearchServer() {
+    {
+        unique_lock lock(mutex_);
+        stopping_ = true;
+    }
+    merge_cv_.notify_all();
+    merge_thread_.join();
+}
+
+void SegmentedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status, const vector<int>& ratings) {
+    unique_lock lock(mutex_);
+    if (documents_.count(document_id) != 0) throw invalid_argument("document id already exists");
+    if (document_id < 0) throw invalid_argument("negative document id");
+
+    vector<string_view> words = SplitIntoValidWords(document);
+    words.erase(remove_if(words.begin(), words.end(), [this](string_view word) { return stop_words_.count(word) > 0; }), words.end());
+
+    Segment& open = segments_.back();
+    const DocumentOrdinal ordinal = open.index->AddDocument(document_id, words, status, ComputeAverageRating(ratings));
+    open.deleted.push_back(false);
+    open.deleted_term_counts.resize(open.index->GetTermCount(), 0);
+    ++open.live_count;
+    documents_.emplace(document_id, DocumentLocation{ open.index.get(), ordinal });
+
+    if (open.index->GetOrdinalCount() >= SEGMENT_SEAL_DOCUMENT_COUNT) {
+        open.index->Seal();
+        OpenSegment();
+        merge_cv_.notify_all();
+    }
+}
+
+void SegmentedSearchServer::RemoveDocument(int document_id) {
+    unique_lock lock(mutex_);
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return;
+    }
+    MarkDeleted(FindSegment(it->second.segment), it->second.ordinal);
+    documents_.erase(it);
+    // A segment that is mostly tombstones gets compacted
+    merge_cv_.notify_all();
+}
+
+tuple<vector<string_view>, DocumentStatus> SegmentedSearchServer::MatchDocument(string_view raw_query, int document_id) const {
+    const Query query = ParseQuery(raw_query, stop_words_, true, QuerySyntax::PLAIN);
+    shared_lock lock(mutex_);
+    const DocumentLocation& location = documents_.at(document_id);
+    const IndexSegment& segment = *location.segment;
+    const WordFrequencies word_freqs = segment.GetWordFrequencies(location.ordinal);
+    const DocumentStatus status = segment.GetDocumentInfo(location.ordinal).status;
+    auto in_document = [&](string_view word) {
+        const TermId term = segment.FindTerm(word);
+        return term != NO_TERM && word_freqs.ContainsTerm(term);
+    };
+
+    vector<string_view> matched_words;
+    if (any_of(query.minus_words.begin(), query.minus_words.end(), in_document)) {
+        return { matched_words, status };
+    }
+    // Plus words are already sorted and unique
+    copy_if(query.plus_words.begin(), query.plus_words.end(), back_inserter(matched_words), in_document);
+    return { matched_words, status };
+}
+
+int SegmentedSearchServer::GetDocumentCount() const {
+    shared_lock lock(mutex_);
+    return documents_.size();
+}
+
+size_t SegmentedSearchServer::GetSegmentCount() const {
+    shared_lock lock(mutex_);
+    return segments_.size();
+}
+
+void SegmentedSearchServer::SetMaxResultDocumentCount(size_t count) {
+    unique_lock lock(mutex_);
+    max_result_document_count_ = count;
+}
+
+size_t SegmentedSearchServer::GetMaxResultDocumentCount() const {
+    shared_lock lock(mutex_);
+    return max_result_document_count_;
+}
+
+void SegmentedSearchServer::SetQueryMode(QueryMode mode) {
+    unique_lock lock(mutex_);
+    query_mode_ = mode;
+}
+
+QueryMode SegmentedSearchServer::GetQueryMode() const {
+    shared_lock lock(mutex_);
+    return query_mode_;
+}
+
+void SegmentedSearchServer::SetMatchMode(MatchMode mode) {
+    unique_lock lock(mutex_);
+    match_mode_ = mode;
+}
+
+MatchMode SegmentedSearchServer::GetMatchMode() const {
+    shared_lock lock(mutex_);
+    return match_mode_;
+}
+
+void SegmentedSearchServer::WaitForMerges() {
+    unique_lock lock(mutex_);
+    merge_cv_.wait(lock, [this] { return !merging_ && !PlanMerge(); });
+}
+
+void SegmentedSearchServer::StartMerging() {
+    OpenSegment();
+    merge_thread_ = thread([this] { RunMerges(); });
+}
+
+void SegmentedSearchServer::OpenSegment() {
+    segments_.emplace_back();
+    segments_.back().index = make_shared<IndexSegment>();
+}
+
+SegmentedSearchServer::Segment& SegmentedSearchServer::FindSegment(const IndexSegment* index) {
+    return *find_if(segments_.begin(), segments_.end(), [index](const Segment& segment) { return segment.index.get() == index; });
+}
+
+void SegmentedSearchServer::MarkDeleted(Segment& segment, DocumentOrdinal ordinal) {
+    segment.deleted[ordinal] = true;
+    --segment.live_count;
+    const WordFrequencies word_freqs = segment.index->GetWordFrequencies(ordinal);
+    for (const TermFreq* entry = word_freqs.data(); entry != word_freqs.data() + word_freqs.size(); ++entry) {
+        ++segment.deleted_term_counts[entry->term];
+    }
+}
+
+vector<QueryPostings> SegmentedSearchServer::FindQueryPostings(const Query& query) const {
+    vector<QueryPostings> segment_postings(segments_.size());
+    for (string_view word : query.plus_words) {
+        // Found posting lists by segment, with the live documents they hold
+        vector<const PostingList*> postings(segments_.size());
+        size_t document_freq = 0;
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            const Segment& segment = segments_[i];
+            const TermId term = segment.index->FindTerm(word);
+            if (term != NO_TERM && (postings[i] = segment.index->FindPostings(term))) {
+                document_freq += postings[i]->size() - segment.deleted_term_counts[term];
+            }
+        }
+        // Words only removed documents had are unknown to SearchServer as well
+        const double inverse_document_freq = document_freq == 0 ? 0.0 : log(documents_.size() * 1.0 / document_freq);
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            if (postings[i] && document_freq > 0) {
+                segment_postings[i].plus.push_back({ postings[i]->GetSpan(), inverse_document_freq });
+            }
+            else {
+                segment_postings[i].has_missing_plus_word = true;
+            }
+        }
+    }
+    for (string_view word : query.minus_words) {
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            const TermId term = segments_[i].index->FindTerm(word);
+            if (term == NO_TERM) {
+                continue;
+            }
+            if (const PostingList* postings = segments_[i].index->FindPostings(term)) {
+                segment_postings[i].minus.push_back(postings->GetSpan());
+            }
+        }
+    }
+    return segment_postings;
+}
+
+optional<SegmentedSearchServer::MergePlan> SegmentedSearchServer::PlanMerge() const {
+    const size_t sealed_count = segments_.size() - 1;
+    // A segment where tombstones outnumber live documents is rewritten on its own
+    for (size_t i = 0; i < sealed_count; ++i) {
+        if (segments_[i].live_count * 2 < segments_[i].deleted.size()) {
+            return MergePlan{ i, 1 };
+        }
+    }
+    // Sealing one segment after another and merging neighbours of similar size works like a binary counter
+    if (sealed_count >= 2
+        && segments_[sealed_count - 2].live_count <= SEGMENT_MERGE_RATIO * segments_[sealed_count - 1].live_count) {
+        return MergePlan{ sealed_count - 2, 2 };
+    }
+    return nullopt;
+}
+
+void SegmentedSearchServer::RunMerges() {
+    unique_lock lock(mutex_);
+    while (true) {
+        merge_cv_.wait(lock, [this] { return stopping_ || PlanMerge(); });
+        if (stopping_) {
+            return;
+        }
+        const MergePlan plan = *PlanMerge();
+        merging_ = true;
+        lock.unlock();
+        Merge(plan);
+        lock.lock();
+        merging_ = false;
+        merge_cv_.notify_all();
+    }
+}
+
+// Only this thread removes segments, others just append, so the planned range stays in place throughout
+void SegmentedSearchServer::Merge(MergePlan plan) {
+    vector<shared_ptr<IndexSegment>> inputs;
+    vector<vector<bool>> deleted;
+    {
+        shared_lock lock(mutex_);
+        for (size_t i = plan.first; i < plan.first + plan.count; ++i) {
+            inputs.push_back(segments_[i].index);
+            deleted.push_back(segments_[i].deleted);
+        }
+    }
+
+    // The slow part runs unlocked: sealed segments are immutable
+    vector<const IndexSegment*> input_indexes;
+    for (const auto& input : inputs) {
+        input_indexes.push_back(input.get());
+    }
+    Segment merged;
+    merged.index = make_shared<IndexSegment>(IndexSegment::Merge(input_indexes, deleted));
+    merged.deleted.assign(merged.index->GetOrdinalCount(), false);
+    merged.deleted_term_counts.assign(merged.index->GetTermCount(), 0);
+    merged.live_count = merged.index->GetOrdinalCount();
+
+    unique_lock lock(mutex_);
+    DocumentOrdinal merged_ordinal = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const Segment& input = segments_[plan.first + i];
+        for (DocumentOrdinal ordinal = 0; ordinal < input.index->GetOrdinalCount(); ++ordinal) {
+            if (deleted[i][ordinal]) {
+                continue;
+            }
+            // Removed while merging; the id may already belong to a newer document
+            if (input.deleted[ordinal]) {
+                MarkDeleted(merged, merged_ordinal);
+            }
+            else {
+                documents_.at(input.index->GetDocumentInfo(ordinal).id) = { merged.index.get(), merged_ordinal };
+            }
+            ++merged_ordinal;
+        }
+    }
+    const auto first = segments_.begin() + plan.first;
+    const auto last = segments_.erase(first, first + plan.count);
+    if (merged.live_count > 0) {
+        segments_.insert(last, move(merged));
+    }
+}
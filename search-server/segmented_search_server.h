@@ -0,0 +1,195 @@
+#pragma once
+#include <condition_variable>
+#include <execution>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include "document.h"
+#include "index_segment.h"
+#include "query.h"
+#include "query_engine.h"
+#include "score_accumulator.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "top_documents.h"
+
+// The open segment is sealed once it holds this many documents
+const size_t SEGMENT_SEAL_DOCUMENT_COUNT = 4096;
+// The newest sealed segment is merged into its older neighbour once the neighbour is at most this many times larger
+const size_t SEGMENT_MERGE_RATIO = 2;
+
+// Index split into segments, LSM style. New documents go into a small open segment that is sealed when full,
+// so adding never touches the bulk of the index. Removal only sets a tombstone. A background thread merges
+// sealed segments of similar size and drops removed documents, which keeps the segment count logarithmic.
+// Queries run over all segments with corpus-wide IDF and merge the per-segment tops, so they return
+// the same documents as SearchServer. All methods may be called from any thread.
+// Segments keep no word positions, so quotes and NEAR/k are parts of plain words, as in a SearchServer without them.
+class SegmentedSearchServer {
+public:
+    template <typename StringContainer>
+    explicit SegmentedSearchServer(const StringContainer& stop_words);
+    explicit SegmentedSearchServer(const std::string& stop_words_text);
+    explicit SegmentedSearchServer(std::string_view stop_words_text);
+    SegmentedSearchServer(const SegmentedSearchServer&) = delete;
+    SegmentedSearchServer& operator=(const SegmentedSearchServer&) = delete;
+    ~SegmentedSearchServer();
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+    void RemoveDocument(int document_id);
+
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentStatus status) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    }
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
+        return FindTopDocuments(std::execution::seq, raw_query, status);
+    }
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const {
+        return FindTopDocuments(std::execution::seq, raw_query);
+    }
+
+    // Throws out_of_range for unknown documents, like SearchServer::MatchDocument
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+    // Including the open segment
+    size_t GetSegmentCount() const;
+
+    void SetMaxResultDocumentCount(size_t count);
+    size_t GetMaxResultDocumentCount() const;
+
+    void SetQueryMode(QueryMode mode);
+    QueryMode GetQueryMode() const;
+    void SetMatchMode(MatchMode mode);
+    MatchMode GetMatchMode() const;
+
+    // Blocks until the background thread has nothing left to merge
+    void WaitForMerges();
+
+private:
+    // Never a real id, since AddDocument rejects negative ones
+    static constexpr int REMOVED_DOCUMENT_ID = -1;
+
+    struct Segment {
+        // Immutable once sealed, so merges read it without holding the lock
+        std::shared_ptr<IndexSegment> index;
+        // Tombstones by ordinal
+        std::vector<bool> deleted;
+        // Removed documents per term, so live document frequencies need no posting scan
+        std::vector<uint32_t> deleted_term_counts;
+        size_t live_count = 0;
+    };
+
+    struct DocumentLocation {
+        const IndexSegment* segment;
+        DocumentOrdinal ordinal;
+    };
+
+    // Sealed segments [first, first + count) are to become one
+    struct MergePlan {
+        size_t first;
+        size_t count;
+    };
+
+    StopWords stop_words_;
+    mutable std::shared_mutex mutex_;
+    // Oldest first; the last segment is the open one
+    std::vector<Segment> segments_;
+    std::map<int, DocumentLocation> documents_;
+    mutable ScoreAccumulatorPool accumulators_;
+    size_t max_result_document_count_ = MAX_RESULT_DOCUMENT_COUNT;
+    QueryMode query_mode_ = QueryMode::EXHAUSTIVE;
+    MatchMode match_mode_ = MatchMode::ANY;
+
+    std::condition_variable_any merge_cv_;
+    bool merging_ = false;
+    bool stopping_ = false;
+    std::thread merge_thread_;
+
+    void StartMerging();
+    void OpenSegment();
+    Segment& FindSegment(const IndexSegment* index);
+    void MarkDeleted(Segment& segment, DocumentOrdinal ordinal);
+
+    // One QueryPostings per segment, scored with IDF over the live documents of all segments. Requires the lock.
+    std::vector<QueryPostings> FindQueryPostings(const Query& query) const;
+
+    // Requires the lock
+    std::optional<MergePlan> PlanMerge() const;
+    void RunMerges();
+    void Merge(MergePlan plan);
+};
+
+/*********************************************************************************/
+template <typename StringContainer>
+SegmentedSearchServer::SegmentedSearchServer(const StringContainer& stop_words) {
+    for (std::string_view word : MakeUniqueNonEmptyStrings(stop_words)) {
+        stop_words_.insert(std::string(word));
+    }
+    StartMerging();
+}
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    AddQueryCount(QueryCounter::QUERIES, 1);
+    // Stop words never change, so parsing needs no lock and its time holds no lock wait
+    const Query query = [&] {
+        QueryStageTimer parse_timer(QueryStage::PARSE);
+        return ParseQuery(raw_query, stop_words_, true, QuerySyntax::PLAIN);
+    }();
+    std::shared_lock lock(mutex_);
+    std::vector<QueryPostings> segment_postings = FindQueryPostings(query);
+
+    // Each segment contributes its own top; the overall top is among them
+    std::vector<Document> top_documents;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (segment_postings[i].plus.empty()) {
+            continue;
+        }
+        const Segment& segment = segments_[i];
+        const auto documents = EvaluateQuery(policy, query_mode_, match_mode_, TfIdfScorer{}, std::move(segment_postings[i]),
+            segment.index->GetOrdinalCount(), max_result_document_count_, accumulators_,
+            [&segment](DocumentOrdinal ordinal) {
+                DocumentInfo info = segment.index->GetDocumentInfo(ordinal);
+                if (segment.deleted[ordinal]) {
+                    info.id = REMOVED_DOCUMENT_ID;
+                }
+                return info;
+            },
+            [&document_predicate](int document_id, DocumentStatus status, int rating) {
+                return document_id != REMOVED_DOCUMENT_ID && document_predicate(document_id, status, rating);
+            });
+        top_documents.insert(top_documents.end(), documents.begin(), documents.end());
+    }
+    QueryStageTimer top_k_timer(QueryStage::TOP_K);
+    SelectTopDocuments(std::execution::seq, top_documents, max_result_document_count_);
+    return top_documents;
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentStatus status) const {
+    return FindTopDocuments(
+        policy,
+        raw_query,
+        [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        });
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SegmentedSearchServer::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "snapshot.h"
+
+using namespace std;
+
+namespace {
+
+// Every section starts at a multiple of this, so mapped arrays are naturally aligned
+const uint64_t SECTION_ALIGNMENT = 8;
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+// Reads back differently on a machine with the other byte order
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+static_assert(sizeof(int) == 4 && sizeof(TermFreq) == 8 && sizeof(double) == 8, "snapshot layout assumes these sizes");
+
+enum SectionId {
+    STOP_WORD_OFFSETS,
+    STOP_WORD_BYTES,
+    TERM_OFFSETS,
+    TERM_BYTES,
+    TERM_SLOTS,
+    POSTING_OFFSETS,
+    POSTING_ORDINALS,
+    POSTING_FREQS,
+    MAX_TERM_FREQS,
+    INVERSE_DOCUMENT_FREQS,
+    FORWARD_OFFSETS,
+    FORWARD_ENTRIES,
+    DOCUMENT_IDS,
+    DOCUMENT_RATINGS,
+    DOCUMENT_STATUSES,
+    DOCUMENT_WORD_COUNTS,
+    SECTION_COUNT,
+};
+
+struct Section {
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t stop_word_count;
+    uint64_t term_count;
+    uint64_t term_slot_count;
+    uint64_t posting_count;
+    uint64_t forward_entry_count;
+    uint64_t document_count;
+    // Whether the saving server indexed word positions, and so parsed phrases and NEAR/k
+    uint64_t position_indexing;
+    uint64_t ranking_function;
+    // Over the documents of the snapshot, as BM25 on the saving server used it
+    double average_word_count;
+    Section sections[SECTION_COUNT];
+};
+
+static_assert(sizeof(SnapshotHeader) % SECTION_ALIGNMENT == 0);
+
+// FNV-1a; the slot table of a snapshot depends on it, so it must not change within a version
+uint64_t HashWord(string_view word) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Writes sections one after another and the header last, once all of them are placed
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const string& path)
+        : out_(path, ios::binary | ios::trunc) {
+        if (!out_) {
+            throw runtime_error("cannot create " + path);
+        }
+        out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+        offset_ = sizeof(header_);
+    }
+
+    SnapshotHeader& GetHeader() {
+        return header_;
+    }
+
+    template <typename T>
+    void WriteSection(SectionId id, const T* data, size_t count) {
+        static const char padding[SECTION_ALIGNMENT] = {};
+        const uint64_t padding_size = (SECTION_ALIGNMENT - offset_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT;
+        out_.write(padding, padding_size);
+        offset_ += padding_size;
+        header_.sections[id] = { offset_, count * sizeof(T) };
+        out_.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+        offset_ += count * sizeof(T);
+    }
+    template <typename T>
+    void WriteSection(SectionId id, const vector<T>& data) {
+        WriteSection(id, data.data(), data.size());
+    }
+
+    void Finish() {
+        out_.seekp(0);
+        out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+        out_.close();
+        if (!out_) {
+            throw runtime_error("cannot write snapshot");
+        }
+    }
+
+private:
+    ofstream out_;
+    SnapshotHeader header_ = {};
+    uint64_t offset_ = 0;
+};
+
+// Deletes a partly written file unless the write got to the end
+class TempFileRemover {
+public:
+    explicit TempFileRemover(string path)
+        : path_(move(path)) {
+    }
+    TempFileRemover(const TempFileRemover&) = delete;
+    TempFileRemover& operator=(const TempFileRemover&) = delete;
+    ~TempFileRemover() {
+        if (!path_.empty()) {
+            error_code ignored;
+            filesystem::remove(path_, ignored);
+        }
+    }
+
+    void Release() {
+        path_.clear();
+    }
+
+private:
+    string path_;
+};
+
+// Words are stored back to back, word i spans [offsets[i], offsets[i + 1])
+template <typename Words>
+void WriteWords(SnapshotWriter& writer, SectionId offsets_id, SectionId bytes_id, const Words& words) {
+    vector<uint64_t> offsets{ 0 };
+    string bytes;
+    for (string_view word : words) {
+        bytes += word;
+        offsets.push_back(bytes.size());
+    }
+    writer.WriteSection(offsets_id, offsets);
+    writer.WriteSection(bytes_id, bytes.data(), bytes.size());
+}
+
+template <typename T>
+const T* MapSection(const MappedFile& file, const SnapshotHeader& header, SectionId id, uint64_t count) {
+    const Section& section = header.sections[id];
+    if (section.offset % SECTION_ALIGNMENT != 0 || section.size != count * sizeof(T)
+        || section.offset > file.size() || section.size > file.size() - section.offset) {
+        throw invalid_argument("corrupted snapshot");
+    }
+    return reinterpret_cast<const T*>(file.data() + section.offset);
+}
+
+}  // namespace
+
+// Live documents get new ordinals in ascending id order and terms without postings are dropped,
+// so the snapshot carries no holes left by removals. The file is written next to the target
+// and renamed over it, which leaves readers of the previous snapshot with their old, intact mapping.
+// A failed save removes the file it was writing.
+void SearchServer::SaveSnapshot(const string& path) const {
+    const string temp_path = path + ".tmp";
+    TempFileRemover temp_file(temp_path);
+    SnapshotWriter writer(temp_path);
+
+    WriteWords(writer, STOP_WORD_OFFSETS, STOP_WORD_BYTES, stop_words_);
+
+    const DocumentOrdinal NO_ORDINAL = ~DocumentOrdinal{ 0 };
+    vector<DocumentOrdinal> new_ordinals(document_table_.size(), NO_ORDINAL);
+    vector<int> document_ids;
+    vector<int> document_ratings;
+    vector<int> document_statuses;
+    vector<uint32_t> document_word_counts;
+    for (const auto& [document_id, ordinal] : documents_) {
+        const DocumentInfo info = document_table_.Get(ordinal);
+        new_ordinals[ordinal] = static_cast<DocumentOrdinal>(document_ids.size());
+        document_ids.push_back(document_id);
+        document_ratings.push_back(info.rating);
+        document_statuses.push_back(static_cast<int>(info.status));
+        document_word_counts.push_back(document_table_.GetWordCount(ordinal));
+    }
+
+    // Kept terms retain their relative order, so forward entries stay sorted by term
+    vector<TermId> new_terms(terms_.size(), NO_TERM);
+    vector<string_view> term_words;
+    vector<const PostingList*> term_postings;
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        if (const PostingList* postings = term_to_postings_.Find(term)) {
+            new_terms[term] = static_cast<TermId>(term_words.size());
+            term_words.push_back(terms_.GetTerm(term));
+            term_postings.push_back(postings);
+        }
+    }
+    WriteWords(writer, TERM_OFFSETS, TERM_BYTES, term_words);
+
+    // At most half full, so probe sequences stay short and always end at a free slot
+    size_t slot_count = 1;
+    while (slot_count < term_words.size() * 2) {
+        slot_count *= 2;
+    }
+    vector<TermId> term_slots(slot_count, NO_TERM);
+    for (TermId term = 0; term < term_words.size(); ++term) {
+        size_t slot = HashWord(term_words[term]) & (slot_count - 1);
+        while (term_slots[slot] != NO_TERM) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        term_slots[slot] = term;
+    }
+    writer.WriteSection(TERM_SLOTS, term_slots);
+
+    vector<uint64_t> posting_offsets{ 0 };
+    vector<DocumentOrdinal> posting_ordinals;
+    vector<double> posting_freqs;
+    vector<double> max_term_freqs;
+    vector<double> inverse_document_freqs;
+    vector<Posting> postings;
+    for (const PostingList* list : term_postings) {
+        postings.clear();
+        for (Posting posting : *list) {
+            postings.push_back({ new_ordinals[posting.ordinal], posting.term_freq });
+        }
+        sort(postings.begin(), postings.end(), [](const Posting& lhs, const Posting& rhs) {
+            return lhs.ordinal < rhs.ordinal;
+            });
+        for (const Posting& posting : postings) {
+            posting_ordinals.push_back(posting.ordinal);
+            posting_freqs.push_back(posting.term_freq);
+        }
+        posting_offsets.push_back(posting_ordinals.size());
+        max_term_freqs.push_back(list->GetMaxTermFreq());
+        inverse_document_freqs.push_back(list->GetInverseDocumentFreq(documents_.size()));
+    }
+    writer.WriteSection(POSTING_OFFSETS, posting_offsets);
+    writer.WriteSection(POSTING_ORDINALS, posting_ordinals);
+    writer.WriteSection(POSTING_FREQS, posting_freqs);
+    writer.WriteSection(MAX_TERM_FREQS, max_term_freqs);
+    writer.WriteSection(INVERSE_DOCUMENT_FREQS, inverse_document_freqs);
+
+    vector<uint64_t> forward_offsets{ 0 };
+    vector<TermFreq> forward_entries;
+    for (const auto& [document_id, ordinal] : documents_) {
+        const WordFrequencies word_freqs = forward_index_.Get(ordinal, terms_);
+        for (const TermFreq* entry = word_freqs.data(); entry != word_freqs.data() + word_freqs.size(); ++entry) {
+            forward_entries.push_back({ new_terms[entry->term], entry->freq });
+        }
+        forward_offsets.push_back(forward_entries.size());
+    }
+    writer.WriteSection(FORWARD_OFFSETS, forward_offsets);
+    writer.WriteSection(FORWARD_ENTRIES, forward_entries);
+
+    writer.WriteSection(DOCUMENT_IDS, document_ids);
+    writer.WriteSection(DOCUMENT_RATINGS, document_ratings);
+    writer.WriteSection(DOCUMENT_STATUSES, document_statuses);
+    writer.WriteSection(DOCUMENT_WORD_COUNTS, document_word_counts);
+
+    SnapshotHeader& header = writer.GetHeader();
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.stop_word_count = stop_words_.size();
+    header.term_count = term_words.size();
+    header.term_slot_count = slot_count;
+    header.posting_count = posting_ordinals.size();
+    header.forward_entry_count = forward_entries.size();
+    header.document_count = document_ids.size();
+    header.position_indexing = position_indexing_;
+    header.ranking_function = static_cast<uint64_t>(ranking_function_);
+    header.average_word_count = document_table_.GetAverageWordCount();
+    writer.Finish();
+
+    filesystem::rename(temp_path, path);
+    temp_file.Release();
+}
+
+SnapshotSearcher::SnapshotSearcher(const string& path)
+    : file_(path) {
+    if (file_.size() < sizeof(SnapshotHeader)) {
+        throw invalid_argument("not a search server snapshot");
+    }
+    const SnapshotHeader& header = *reinterpret_cast<const SnapshotHeader*>(file_.data());
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw invalid_argument("not a search server snapshot");
+    }
+    if (header.byte_order != BYTE_ORDER_MARK) {
+        throw invalid_argument("snapshot byte order differs from this machine");
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw invalid_argument("unsupported snapshot version");
+    }
+    if (header.term_slot_count == 0 || (header.term_slot_count & (header.term_slot_count - 1)) != 0
+        || header.term_slot_count <= header.term_count) {
+        throw invalid_argument("corrupted snapshot");
+    }
+
+    document_count_ = header.document_count;
+    query_syntax_ = header.position_indexing ? QuerySyntax::PROXIMITY : QuerySyntax::PLAIN;
+    if (header.ranking_function > static_cast<uint64_t>(RankingFunction::BM25)) {
+        throw invalid_argument("corrupted snapshot");
+    }
+    ranking_function_ = static_cast<RankingFunction>(header.ranking_function);
+    average_word_count_ = header.average_word_count;
+    term_count_ = header.term_count;
+
+    // Only the ends of the offset arrays are checked; the rest of the file is trusted
+    const uint64_t* stop_word_offsets = MapSection<uint64_t>(file_, header, STOP_WORD_OFFSETS, header.stop_word_count + 1);
+    const char* stop_word_bytes = MapSection<char>(file_, header, STOP_WORD_BYTES, stop_word_offsets[header.stop_word_count]);
+    term_offsets_ = MapSection<uint64_t>(file_, header, TERM_OFFSETS, term_count_ + 1);
+    term_bytes_ = MapSection<char>(file_, header, TERM_BYTES, term_offsets_[term_count_]);
+    term_slots_ = MapSection<TermId>(file_, header, TERM_SLOTS, header.term_slot_count);
+    term_slot_mask_ = header.term_slot_count - 1;
+    posting_offsets_ = MapSection<uint64_t>(file_, header, POSTING_OFFSETS, term_count_ + 1);
+    posting_ordinals_ = MapSection<DocumentOrdinal>(file_, header, POSTING_ORDINALS, header.posting_count);
+    posting_freqs_ = MapSection<double>(file_, header, POSTING_FREQS, header.posting_count);
+    max_term_freqs_ = MapSection<double>(file_, header, MAX_TERM_FREQS, term_count_);
+    inverse_document_freqs_ = MapSection<double>(file_, header, INVERSE_DOCUMENT_FREQS, term_count_);
+    forward_offsets_ = MapSection<uint64_t>(file_, header, FORWARD_OFFSETS, document_count_ + 1);
+    forward_entries_ = MapSection<TermFreq>(file_, header, FORWARD_ENTRIES, header.forward_entry_count);
+    document_ids_ = MapSection<int>(file_, header, DOCUMENT_IDS, document_count_);
+    document_ratings_ = MapSection<int>(file_, header, DOCUMENT_RATINGS, document_count_);
+    document_statuses_ = MapSection<int>(file_, header, DOCUMENT_STATUSES, document_count_);
+    document_word_counts_ = MapSection<uint32_t>(file_, header, DOCUMENT_WORD_COUNTS, document_count_);
+    if (posting_offsets_[term_count_] != header.posting_count
+        || forward_offsets_[document_count_] != header.forward_entry_count) {
+        throw invalid_argument("corrupted snapshot");
+    }
+    for (DocumentOrdinal ordinal = 0; ordinal < document_count_; ++ordinal) {
+        status_bitmaps_.Set(ordinal, static_cast<DocumentStatus>(document_statuses_[ordinal]));
+    }
+
+    for (size_t i = 0; i < header.stop_word_count; ++i) {
+        stop_words_.emplace(stop_word_bytes + stop_word_offsets[i], stop_word_offsets[i + 1] - stop_word_offsets[i]);
+    }
+    term_words_.reserve(term_count_);
+    for (size_t term = 0; term < term_count_; ++term) {
+        term_words_.emplace_back(term_bytes_ + term_offsets_[term], term_offsets_[term + 1] - term_offsets_[term]);
+    }
+}
+
+tuple<vector<string_view>, DocumentStatus> SnapshotSearcher::MatchDocument(string_view raw_query, int document_id) const {
+    const Query query = ParseQuery(raw_query, stop_words_, true, query_syntax_);
+    CheckNoProximityClauses(query);
+    const DocumentOrdinal ordinal = FindOrdinal(document_id);
+    if (ordinal == document_count_) {
+        throw out_of_range("document id not found");
+    }
+    const DocumentStatus status = static_cast<DocumentStatus>(document_statuses_[ordinal]);
+    const WordFrequencies word_freqs = GetForwardEntries(ordinal);
+    auto in_document = [&](string_view word) {
+        const TermId term = FindTerm(word);
+        return term != NO_TERM && word_freqs.ContainsTerm(term);
+    };
+
+    vector<string_view> matched_words;
+    if (any_of(query.minus_words.begin(), query.minus_words.end(), in_document)) {
+        return { matched_words, status };
+    }
+    // Plus words are already sorted and unique
+    copy_if(query.plus_words.begin(), query.plus_words.end(), back_inserter(matched_words), in_document);
+    return { matched_words, status };
+}
+
+WordFrequencies SnapshotSearcher::GetWordFrequencies(int document_id) const {
+    const DocumentOrdinal ordinal = FindOrdinal(document_id);
+    return ordinal == document_count_ ? WordFrequencies{} : GetForwardEntries(ordinal);
+}
+
+int SnapshotSearcher::GetDocumentCount() const {
+    return static_cast<int>(document_count_);
+}
+
+const int* SnapshotSearcher::begin() const {
+    return document_ids_;
+}
+
+const int* SnapshotSearcher::end() const {
+    return document_ids_ + document_count_;
+}
+
+void SnapshotSearcher::SetMaxResultDocumentCount(size_t count) {
+    max_result_document_count_ = count;
+}
+
+size_t SnapshotSearcher::GetMaxResultDocumentCount() const {
+    return max_result_document_count_;
+}
+
+void SnapshotSearcher::SetQueryMode(QueryMode mode) {
+    query_mode_ = mode;
+}
+
+QueryMode SnapshotSearcher::GetQueryMode() const {
+    return query_mode_;
+}
+
+void SnapshotSearcher::SetMatchMode(MatchMode mode) {
+    match_mode_ = mode;
+}
+
+MatchMode SnapshotSearcher::GetMatchMode() const {
+    return match_mode_;
+}
+
+RankingFunction SnapshotSearcher::GetRankingFunction() const {
+    return ranking_function_;
+}
+
+TermId SnapshotSearcher::FindTerm(string_view word) const {
+    for (size_t slot = HashWord(word) & term_slot_mask_;; slot = (slot + 1) & term_slot_mask_) {
+        const TermId term = term_slots_[slot];
+        if (term == NO_TERM || term_words_[term] == word) {
+            return term;
+        }
+    }
+}
+
+optional<ScoredPostings> SnapshotSearcher::FindScoredPostings(string_view word) const {
+    const TermId term = FindTerm(word);
+    if (term == NO_TERM) {
+        return nullopt;
+    }
+    const uint64_t first = posting_offsets_[term];
+    const uint64_t last = posting_offsets_[term + 1];
+    return ScoredPostings{ { posting_ordinals_ + first, posting_freqs_ + first, last - first, max_term_freqs_[term] },
+        inverse_document_freqs_[term] };
+}
+
+QueryPostings SnapshotSearcher::FindQueryPostings(const Query& query) const {
+    CheckNoProximityClauses(query);
+    QueryPostings query_postings;
+    for (string_view word : query.plus_words) {
+        if (optional<ScoredPostings> postings = FindScoredPostings(word)) {
+            query_postings.plus.push_back(*postings);
+        }
+        else {
+            query_postings.has_missing_plus_word = true;
+        }
+    }
+    for (string_view word : query.minus_words) {
+        if (optional<ScoredPostings> postings = FindScoredPostings(word)) {
+            query_postings.minus.push_back(postings->postings);
+        }
+    }
+    return query_postings;
+}
+
+DocumentOrdinal SnapshotSearcher::FindOrdinal(int document_id) const {
+    const int* it = lower_bound(begin(), end(), document_id);
+    return it != end() && *it == document_id ? static_cast<DocumentOrdinal>(it - begin()) : static_cast<DocumentOrdinal>(document_count_);
+}
+
+DocumentInfo SnapshotSearcher::GetDocumentInfo(DocumentOrdinal ordinal) const {
+    return { document_ids_[ordinal], document_ratings_[ordinal], static_cast<DocumentStatus>(document_statuses_[ordinal]) };
+}
+
+Bm25Scorer SnapshotSearcher::GetBm25Scorer() const {
+    Bm25Scorer scorer;
+    scorer.word_counts = document_word_counts_;
+    scorer.average_word_count = average_word_count_;
+    return scorer;
+}
+
+WordFrequencies SnapshotSearcher::GetForwardEntries(DocumentOrdinal ordinal) const {
+    return { forward_entries_ + forward_offsets_[ordinal], forward_entries_ + forward_offsets_[ordinal + 1], term_words_.data() };
+}
@@ -0,0 +1,185 @@
+#pragma once
+#include <cstdint>
+#include <execution>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+#include "document.h"
+#include "document_table.h"
+#include "forward_index.h"
+#include "mapped_file.h"
+#include "query.h"
+#include "query_engine.h"
+#include "score_accumulator.h"
+#include "scorer.h"
+#include "search_server.h"
+
+// Layout version written by SearchServer::SaveSnapshot; other versions are refused
+const uint32_t SNAPSHOT_VERSION = 3;
+
+// Serves queries straight from the pages of a snapshot saved by SearchServer::SaveSnapshot.
+// Postings and the forward index are read in place, only the stop words and a table of word views are built on open,
+// so startup costs no tokenizing and processes that open the same file share one copy in the page cache.
+// The snapshot carries the documents, the stop words, the ranking function and the document lengths BM25 needs,
+// so with the same settings the answers are those of the server that saved it. The maximum result count, the query
+// mode and the match mode are settings of the searcher and start at their defaults. Word positions are not saved,
+// so phrase and NEAR queries throw invalid_argument if that server indexed them; otherwise they are plain words there too.
+class SnapshotSearcher {
+public:
+    // Throws runtime_error if the file cannot be mapped and invalid_argument if it is not a readable snapshot
+    explicit SnapshotSearcher(const std::string& path);
+
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentStatus status) const;
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query) const;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    }
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
+        return FindTopDocuments(std::execution::seq, raw_query, status);
+    }
+    std::vector<Document> FindTopDocuments(std::string_view raw_query) const {
+        return FindTopDocuments(std::execution::seq, raw_query);
+    }
+
+    // See SearchServer::FindTopDocumentsBatch
+    template <typename ExecutionPolicy>
+    QueryBatchResults FindTopDocumentsBatch(ExecutionPolicy policy, const std::vector<std::string>& raw_queries) const;
+
+    // Throws out_of_range for unknown documents, like SearchServer::MatchDocument
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
+
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    int GetDocumentCount() const;
+
+    // Document ids in ascending order
+    const int* begin() const;
+    const int* end() const;
+
+    void SetMaxResultDocumentCount(size_t count);
+    size_t GetMaxResultDocumentCount() const;
+
+    void SetQueryMode(QueryMode mode);
+    QueryMode GetQueryMode() const;
+    void SetMatchMode(MatchMode mode);
+    MatchMode GetMatchMode() const;
+    // That of the server that saved the snapshot
+    RankingFunction GetRankingFunction() const;
+
+private:
+    MappedFile file_;
+    StopWords stop_words_;
+    // These two are those of the server that saved the snapshot
+    QuerySyntax query_syntax_ = QuerySyntax::PLAIN;
+    RankingFunction ranking_function_ = RankingFunction::TF_IDF;
+    size_t document_count_ = 0;
+    double average_word_count_ = 0.0;
+    size_t term_count_ = 0;
+
+    // Everything below points into the mapping; arrays are indexed by TermId or by DocumentOrdinal
+    const uint64_t* term_offsets_ = nullptr;
+    const char* term_bytes_ = nullptr;
+    // Open addressing table from word hash to TermId, NO_TERM marks a free slot
+    const TermId* term_slots_ = nullptr;
+    size_t term_slot_mask_ = 0;
+    const uint64_t* posting_offsets_ = nullptr;
+    const DocumentOrdinal* posting_ordinals_ = nullptr;
+    const double* posting_freqs_ = nullptr;
+    const double* max_term_freqs_ = nullptr;
+    const double* inverse_document_freqs_ = nullptr;
+    const uint64_t* forward_offsets_ = nullptr;
+    const TermFreq* forward_entries_ = nullptr;
+    // Ids ascend with the ordinal, so an id is found by binary search
+    const int* document_ids_ = nullptr;
+    const int* document_ratings_ = nullptr;
+    const int* document_statuses_ = nullptr;
+    const uint32_t* document_word_counts_ = nullptr;
+
+    std::vector<std::string_view> term_words_;
+    // Built on open, a bit per document is cheap next to the mapping
+    StatusBitmaps status_bitmaps_;
+    mutable ScoreAccumulatorPool accumulators_;
+    size_t max_result_document_count_ = MAX_RESULT_DOCUMENT_COUNT;
+    QueryMode query_mode_ = QueryMode::EXHAUSTIVE;
+    MatchMode match_mode_ = MatchMode::ANY;
+
+    // Returns NO_TERM for unknown words
+    TermId FindTerm(std::string_view word) const;
+    std::optional<ScoredPostings> FindScoredPostings(std::string_view word) const;
+    QueryPostings FindQueryPostings(const Query& query) const;
+    // Returns document_count_ for unknown ids
+    DocumentOrdinal FindOrdinal(int document_id) const;
+    DocumentInfo GetDocumentInfo(DocumentOrdinal ordinal) const;
+    WordFrequencies GetForwardEntries(DocumentOrdinal ordinal) const;
+    Bm25Scorer GetBm25Scorer() const;
+};
+
+/*********************************************************************************/
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SnapshotSearcher::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
+    AddQueryCount(QueryCounter::QUERIES, 1);
+    QueryPostings query_postings = [&] {
+        QueryStageTimer parse_timer(QueryStage::PARSE);
+        return FindQueryPostings(ParseQuery(raw_query, stop_words_, true, query_syntax_));
+    }();
+    auto evaluate = [&](const auto& scorer) {
+        return EvaluateQuery(policy, query_mode_, match_mode_, scorer, std::move(query_postings), document_count_,
+            max_result_document_count_, accumulators_,
+            [this](DocumentOrdinal ordinal) { return GetDocumentInfo(ordinal); }, document_predicate);
+    };
+    if (ranking_function_ == RankingFunction::BM25) {
+        return evaluate(GetBm25Scorer());
+    }
+    return evaluate(TfIdfScorer{});
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SnapshotSearcher::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query, DocumentStatus status) const {
+    if (const std::optional<OrdinalBitmap> status_bitmap = status_bitmaps_.Find(status)) {
+        return FindTopDocuments(policy, raw_query, *status_bitmap);
+    }
+    return FindTopDocuments(
+        policy,
+        raw_query,
+        [status](int, DocumentStatus document_status, int) {
+            return document_status == status;
+        });
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SnapshotSearcher::FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <typename ExecutionPolicy>
+QueryBatchResults SnapshotSearcher::FindTopDocumentsBatch(ExecutionPolicy policy, const std::vector<std::string>& raw_queries) const {
+    if (match_mode_ == MatchMode::ALL) {
+        return FindTopDocumentsEach(policy, raw_queries, *this);
+    }
+    const QueryBatch batch = [&] {
+        QueryStageTimer parse_timer(QueryStage::PARSE);
+        return ParseQueryBatch(raw_queries, stop_words_, query_syntax_, [this](std::string_view word) { return FindScoredPostings(word); });
+    }();
+    // Those queries throw, as FindTopDocuments does for them
+    if (batch.has_proximity_clauses) {
+        return FindTopDocumentsEach(policy, raw_queries, *this);
+    }
+    AddQueryCount(QueryCounter::QUERIES, raw_queries.size());
+    auto evaluate = [&](const auto& scorer) {
+        return EvaluateQueryBatch(policy, scorer, batch, document_count_, max_result_document_count_, accumulators_,
+            [this](DocumentOrdinal ordinal) { return GetDocumentInfo(ordinal); },
+            *status_bitmaps_.Find(DocumentStatus::ACTUAL));
+    };
+    if (ranking_function_ == RankingFunction::BM25) {
+        return evaluate(GetBm25Scorer());
+    }
+    return evaluate(TfIdfScorer{});
+}
@@ -1,40 +1,163 @@
+#include <cstdint>
 #include <iostream>
 #include <stdexcept>
+#include "bits.h"
 #include "string_processing.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SEARCH_SERVER_SSE2
+#endif
+
 using namespace std;
 
-void CheckWordSymbols(const string& word) {
-    for (char c: word){
-        int symbol = static_cast<int>(c);
-        if (symbol >= 0&&symbol<=31){              
+namespace {
+
+bool IsControlSymbol(char c) {
+    int symbol = static_cast<int>(c);
+    return symbol >= 0 && symbol <= 31;
+}
+
+// Bit i of a mask describes byte i of the block
+struct BlockMasks {
+    uint32_t spaces;
+    uint32_t controls;
+};
+
+#if defined(__AVX2__)
+
+constexpr size_t BLOCK_SIZE = 32;
+constexpr uint32_t BLOCK_MASK = 0xFFFFFFFFu;
+
+BlockMasks ScanBlock(const char* data) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const __m256i spaces = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    // Signed compare: bytes above 127 are negative and stay valid
+    const __m256i controls = _mm256_and_si256(
+        _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(-1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(32), bytes));
+    return { static_cast<uint32_t>(_mm256_movemask_epi8(spaces)), static_cast<uint32_t>(_mm256_movemask_epi8(controls)) };
+}
+
+#elif defined(SEARCH_SERVER_SSE2)
+
+constexpr size_t BLOCK_SIZE = 16;
+constexpr uint32_t BLOCK_MASK = 0xFFFFu;
+
+BlockMasks ScanBlock(const char* data) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    // Signed compare: bytes above 127 are negative and stay valid
+    const __m128i controls = _mm_and_si128(
+        _mm_cmpgt_epi8(bytes, _mm_set1_epi8(-1)),
+        _mm_cmplt_epi8(bytes, _mm_set1_epi8(32)));
+    return { static_cast<uint32_t>(_mm_movemask_epi8(spaces)), static_cast<uint32_t>(_mm_movemask_epi8(controls)) };
+}
+
+#else
+
+constexpr size_t BLOCK_SIZE = 0;
+constexpr uint32_t BLOCK_MASK = 0;
+
+BlockMasks ScanBlock(const char*) {
+    return { 0, 0 };
+}
+
+#endif
+
+void SplitIntoWords(string_view text, vector<string_view>& words, bool check_symbols) {
+    const char* data = text.data();
+    const size_t size = text.size();
+    constexpr size_t NO_WORD = string_view::npos;
+    size_t word_begin = NO_WORD;
+    size_t pos = 0;
+
+    if constexpr (BLOCK_SIZE != 0) {
+        for (; pos + BLOCK_SIZE <= size; pos += BLOCK_SIZE) {
+            const auto [spaces, controls] = ScanBlock(data + pos);
+            if (check_symbols && controls != 0) {
+                throw invalid_argument("invalid symbol");
+            }
+            const uint32_t word_bytes = ~spaces & BLOCK_MASK;
+            const bool inside_word = word_begin != NO_WORD;
+            if (word_bytes == (inside_word ? BLOCK_MASK : 0)) {
+                continue;
+            }
+            // Every set bit is a byte where a word starts or ends
+            uint32_t edges = (word_bytes ^ ((word_bytes << 1) | (inside_word ? 1u : 0u))) & BLOCK_MASK;
+            while (edges != 0) {
+                const size_t edge = pos + CountTrailingZeros(edges);
+                edges &= edges - 1;
+                if (word_begin == NO_WORD) {
+                    word_begin = edge;
+                }
+                else {
+                    words.push_back(text.substr(word_begin, edge - word_begin));
+                    word_begin = NO_WORD;
+                }
+            }
+        }
+    }
+
+    for (; pos < size; ++pos) {
+        const char c = data[pos];
+        if (check_symbols && IsControlSymbol(c)) {
             throw invalid_argument("invalid symbol");
-        }                
+        }
+        if (c == ' ') {
+            if (word_begin != NO_WORD) {
+                words.push_back(text.substr(word_begin, pos - word_begin));
+                word_begin = NO_WORD;
+            }
+        }
+        else if (word_begin == NO_WORD) {
+            word_begin = pos;
+        }
+    }
+    if (word_begin != NO_WORD) {
+        words.push_back(text.substr(word_begin));
     }
 }
 
-void CheckMinusWord(const string& word) {
+}  // namespace
+
+void CheckWordSymbols(string_view word) {
+    size_t pos = 0;
+    if constexpr (BLOCK_SIZE != 0) {
+        for (; pos + BLOCK_SIZE <= word.size(); pos += BLOCK_SIZE) {
+            if (ScanBlock(word.data() + pos).controls != 0) {
+                throw invalid_argument("invalid symbol");
+            }
+        }
+    }
+    for (; pos < word.size(); ++pos) {
+        if (IsControlSymbol(word[pos])) {
+            throw invalid_argument("invalid symbol");
+        }
+    }
+}
+
+void CheckMinusWord(string_view word) {
     if ((word.size() == 1 && word[0] == '-') ||                //check empty word after "-"
         (word.size() > 1 && word[0] == '-' && word[1] == '-')) {    //check "--" in the begining of the word
         throw invalid_argument("invalid minus argument");
     }
 }
 
-vector<string> SplitIntoWords(const string& text) {
-    vector<string> words;
-    string word;
-    for (const char c : text) {
-        if (c == ' ') {
-            if (!word.empty()) {
-                words.push_back(word);
-                word.clear();
-            }
-        } else {
-            word += c;
-        }
-    }
-    if (!word.empty()) {
-        words.push_back(word);
-    }
+vector<string_view> SplitIntoWords(string_view text) {
+    vector<string_view> words;
+    SplitIntoWords(text, words, false);
+    return words;
+}
+
+void SplitIntoValidWords(string_view text, vector<string_view>& words) {
+    SplitIntoWords(text, words, true);
+}
+
+vector<string_view> SplitIntoValidWords(string_view text) {
+    vector<string_view> words;
+    SplitIntoWords(text, words, true);
     return words;
 }
@@ -1,13 +1,20 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 
 template <typename StringContainer>
 std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings);
-void CheckWordSymbols(const std::string& word);
-void CheckMinusWord(const std::string& word);
-std::vector<std::string> SplitIntoWords(const std::string& text);
+void CheckWordSymbols(std::string_view word);
+void CheckMinusWord(std::string_view word);
+
+// Words are views into text, which must outlive them
+std::vector<std::string_view> SplitIntoWords(std::string_view text);
+// Same split, but also throws invalid_argument if the text contains control characters.
+// Appends to words, so a reused vector makes tokenization allocation-free.
+void SplitIntoValidWords(std::string_view text, std::vector<std::string_view>& words);
+std::vector<std::string_view> SplitIntoValidWords(std::string_view text);
 
 
 /*********************************************************/
@@ -15,11 +22,11 @@ std::vector<std::string> SplitIntoWords(const std::string& text);
 template <typename StringContainer>
 std::set<std::string> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string> non_empty_strings;
-    for (const std::string& str : strings) {
+    for (std::string_view str : strings) {
         if (!str.empty()) {
             CheckWordSymbols(str);
-            non_empty_strings.insert(str);
+            non_empty_strings.insert(std::string(str));
         }
     }
     return non_empty_strings;
-}
\ No newline at end of file
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include "term_dictionary.h"
+
+using namespace std;
+
+TermDictionary::TermDictionary(const TermDictionary& other) {
+    *this = other;
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this == &other) {
+        return *this;
+    }
+    // Views must point into our own arena, so the words are interned again in id order
+    blocks_.clear();
+    block_used_ = ARENA_BLOCK_SIZE;
+    arena_bytes_ = 0;
+    terms_.clear();
+    term_ids_.clear();
+    terms_.reserve(other.terms_.size());
+    term_ids_.reserve(other.term_ids_.size());
+    for (string_view word : other.terms_) {
+        Intern(word);
+    }
+    return *this;
+}
+
+TermId TermDictionary::Intern(string_view word) {
+    if (auto it = term_ids_.find(word); it != term_ids_.end()) {
+        return it->second;
+    }
+    const TermId term = static_cast<TermId>(terms_.size());
+    const string_view stored = Store(word);
+    terms_.push_back(stored);
+    term_ids_.emplace(stored, term);
+    return term;
+}
+
+TermId TermDictionary::Find(string_view word) const {
+    auto it = term_ids_.find(word);
+    return it == term_ids_.end() ? NO_TERM : it->second;
+}
+
+size_t TermDictionary::GetMemoryUsage() const {
+    // Hash node: next link, cached hash, key and value
+    constexpr size_t hash_node_size = 2 * sizeof(void*) + sizeof(string_view) + sizeof(TermId);
+    return arena_bytes_
+        + terms_.capacity() * sizeof(string_view)
+        + term_ids_.bucket_count() * sizeof(void*) + term_ids_.size() * hash_node_size;
+}
+
+string_view TermDictionary::Store(string_view word) {
+    char* data;
+    if (word.size() > ARENA_BLOCK_SIZE) {
+        // An oversized word gets a block of its own; the current block stays the last one
+        auto block = make_unique<char[]>(word.size());
+        data = block.get();
+        blocks_.insert(blocks_.empty() ? blocks_.end() : prev(blocks_.end()), move(block));
+        arena_bytes_ += word.size();
+    }
+    else {
+        if (blocks_.empty() || ARENA_BLOCK_SIZE - block_used_ < word.size()) {
+            blocks_.push_back(make_unique<char[]>(ARENA_BLOCK_SIZE));
+            block_used_ = 0;
+            arena_bytes_ += ARENA_BLOCK_SIZE;
+        }
+        data = blocks_.back().get() + block_used_;
+        block_used_ += word.size();
+    }
+    memcpy(data, word.data(), word.size());
+    return { data, word.size() };
+}
+
+vector<pair<TermId, double>> InternDocumentTerms(TermDictionary& terms, const vector<string_view>& words) {
+    vector<TermId> document_terms;
+    document_terms.reserve(words.size());
+    for (string_view word : words) {
+        document_terms.push_back(terms.Intern(word));
+    }
+    sort(document_terms.begin(), document_terms.end());
+
+    // Repeated addition rather than count * inv_word_count keeps the frequencies bit-identical to per-word accumulation
+    const double inv_word_count = 1.0 / words.size();
+    vector<pair<TermId, double>> term_freqs;
+    for (auto it = document_terms.begin(); it != document_terms.end();) {
+        const TermId term = *it;
+        double term_freq = 0.0;
+        for (; it != document_terms.end() && *it == term; ++it) {
+            term_freq += inv_word_count;
+        }
+        term_freqs.emplace_back(term, term_freq);
+    }
+    return term_freqs;
+}
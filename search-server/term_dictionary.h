@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Dense number of a distinct word, assigned in order of first appearance
+using TermId = uint32_t;
+
+const TermId NO_TERM = ~TermId{ 0 };
+
+// Interns words: every distinct word is stored once in an append-only arena and gets a TermId.
+// Views returned by GetTerm stay valid for the lifetime of the dictionary.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary& other);
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+
+    // Returns the id of the word, adding it if it is new
+    TermId Intern(std::string_view word);
+    // Returns NO_TERM for unknown words
+    TermId Find(std::string_view word) const;
+
+    std::string_view GetTerm(TermId term) const {
+        return terms_[term];
+    }
+    // Words indexed by TermId
+    const std::vector<std::string_view>& GetTerms() const {
+        return terms_;
+    }
+    size_t size() const {
+        return terms_.size();
+    }
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+    // Blocks never move or grow, so the views into them remain valid
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_used_ = ARENA_BLOCK_SIZE;
+    // Bytes allocated for blocks, including their unused tails
+    size_t arena_bytes_ = 0;
+    std::vector<std::string_view> terms_;
+    std::unordered_map<std::string_view, TermId> term_ids_;
+
+    std::string_view Store(std::string_view word);
+};
+
+// Interns the words of one document and returns its distinct terms in ascending TermId order,
+// each with the share of the document's words it makes up
+std::vector<std::pair<TermId, double>> InternDocumentTerms(TermDictionary& terms, const std::vector<std::string_view>& words);
@@ -0,0 +1,71 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+#include "document.h"
+
+const double EPSILON = 1e-6;
+
+// Ranking order of search results: relevance first, rating breaks near-ties and the lower id the rest,
+// so every document has a place of its own and result pages can resume after any of them.
+// Near-ties are relevances in the same EPSILON-wide bucket rather than closer than EPSILON: that relation
+// is transitive, so chains of close relevances still get one consistent order.
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    const double lhs_bucket = std::floor(lhs.relevance / EPSILON);
+    const double rhs_bucket = std::floor(rhs.relevance / EPSILON);
+    if (lhs_bucket != rhs_bucket) {
+        return lhs_bucket > rhs_bucket;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+// Leaves the best `count` documents in ranking order and drops the rest.
+// Only the selected prefix is ever sorted, so the cost is O(n log count) instead of O(n log n).
+template <typename ExecutionPolicy>
+void SelectTopDocuments(ExecutionPolicy&& policy, std::vector<Document>& documents, size_t count) {
+    if (count == 0) {
+        documents.clear();
+        return;
+    }
+    if (documents.size() <= count) {
+        std::sort(documents.begin(), documents.end(), IsMoreRelevant);
+        return;
+    }
+
+    constexpr size_t min_chunk_size = 4096;
+    const size_t chunk_count = std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>
+        ? 1
+        : std::max<size_t>(1, documents.size() / std::max(min_chunk_size, count * 8));
+
+    if (chunk_count > 1) {
+        // Every chunk keeps its own best `count` at the front, then the survivors compete
+        const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+        std::vector<size_t> chunk_begins(chunk_count);
+        std::iota(chunk_begins.begin(), chunk_begins.end(), size_t{ 0 });
+        std::for_each(policy, chunk_begins.begin(), chunk_begins.end(), [&](size_t& begin) {
+            begin *= chunk_size;
+            const auto first = documents.begin() + begin;
+            const auto last = documents.begin() + std::min(begin + chunk_size, documents.size());
+            std::partial_sort(first, first + std::min<size_t>(count, last - first), last, IsMoreRelevant);
+            });
+
+        std::vector<Document> candidates;
+        candidates.reserve(chunk_count * count);
+        for (size_t begin : chunk_begins) {
+            const size_t end = std::min(begin + chunk_size, documents.size());
+            candidates.insert(candidates.end(), documents.begin() + begin,
+                documents.begin() + begin + std::min(count, end - begin));
+        }
+        documents.swap(candidates);
+    }
+
+    const size_t selected = std::min(count, documents.size());
+    std::partial_sort(documents.begin(), documents.begin() + selected, documents.end(), IsMoreRelevant);
+    documents.resize(selected);
+}